@@ -15,6 +15,7 @@ bootmenu_sources := \
     checkup.c \
     default_bootmenu_ui.c \
     ui.c \
+    key_queue.c \
 
 BOOTMENU_VERSION:=2.0-beta
 
@@ -63,6 +64,11 @@ ifeq ($(TARGET_BOOTLOADER_BOARD_NAME),olympus)
     EXTRA_CFLAGS += -DUNLOCKED_DEVICE -DNO_OVERCLOCK
 endif
 
+# Don't load the UI in the background while the pre-menu scripts run
+ifeq ($(BOARD_BOOTMENU_PRELOAD),false)
+    EXTRA_CFLAGS += -DBOARD_BOOTMENU_NO_PRELOAD
+endif
+
 ifneq ($(BOARD_DEFY_MODEL),DEFY_FROYO)
     EXTRA_CFLAGS += -DUSE_4_CLOCK_LEVELS
 endif
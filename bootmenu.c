@@ -67,6 +67,9 @@ struct UiMenuItem MENU_ITEMS[] = {
 static char** main_headers = NULL;
 static float progress_value = 0.0;
 
+// menu headers, what is left is released when the UI exits
+static struct arena menu_arena = ARENA_INIT("menu");
+
 /**
  * prepend_title()
  *
@@ -90,7 +93,7 @@ char** prepend_title(const char** headers) {
   for (p = title; *p; ++p, ++count);
   for (p = (char**) headers; *p; ++p, ++count);
 
-  char** new_headers = malloc((count+1) * sizeof(char*));
+  char** new_headers = arena_alloc(&menu_arena, (count+1) * sizeof(char*));
   char** h = new_headers;
   for (p = title; *p; ++p, ++h) *h = *p;
   for (p = (char**) headers; *p; ++p, ++h) *h = *p;
@@ -103,7 +106,7 @@ void free_menu_headers(char **headers) {
   char** p = headers;
   for (p = headers; *p; ++p) *p = NULL;
   if (headers != NULL) {
-    free(headers);
+    arena_free(&menu_arena, headers);
     headers = NULL;
   }
 }
@@ -274,8 +277,14 @@ static void prompt_and_wait() {
  *
  */
 static void ui_finish(void) {
+  size_t leaked;
+
   LOGI("Exiting....\n");
   ui_final();
+
+  leaked = arena_release(&menu_arena);
+  if (leaked)
+    LOGI("%u bytes of menu headers were not freed\n", (unsigned) leaked);
 }
 
 /**
@@ -317,6 +326,7 @@ static int run_bootmenu_ui(int mode) {
   ui_reset_progress();
 
   main_headers = prepend_title((const char**)MENU_HEADERS);
+  ui_set_splash_menu(main_headers);
 
   /*
   ui_start_menu(main_headers, TABS, MENU_ITEMS, 0);
@@ -348,6 +358,7 @@ static int run_bootmenu_ui(int mode) {
   log_dumpfile("/proc/cpuinfo");
 
   prompt_and_wait();
+  ui_set_splash_menu(NULL);
   free_menu_headers(main_headers);
 
   ui_finish();
@@ -369,6 +380,9 @@ static int run_bootmenu(void) {
 
   if (bypass_check()) {
 
+    // the menu may be shown, load it while the scripts run
+    ui_preload();
+
     // init rootfs and mount cache
     exec_script(FILE_PRE_MENU, DISABLE, NULL);
 
@@ -405,6 +419,11 @@ static int run_bootmenu(void) {
     // on timeout
     if (status != BUTTON_PRESSED) {
 
+      // modes which don't end in the menu
+      if (mode != int_mode("bootmenu") && mode != int_mode("shell")
+       && mode != int_mode("2nd-system-recovery"))
+          ui_preload_drop();
+
       if (mode == int_mode("bootmenu")) {
           led_alert("blue", DISABLE);
           status = BUTTON_PRESSED;
@@ -481,6 +500,8 @@ static int run_bootmenu(void) {
         led_alert("button-backlight", ENABLE);
 
         run_bootmenu_ui(mode);
+    } else {
+        ui_preload_drop();
     }
     
     // cleanup multiboot
@@ -519,6 +540,7 @@ int main(int argc, char **argv) {
 
 #ifndef UNLOCKED_DEVICE
     fprintf(stdout, "Run BootMenu..\n");
+    ui_preload();
     exec_script(FILE_PRE_MENU, DISABLE, NULL);
 
     // initialize multiboot
@@ -66,6 +66,11 @@ struct ui_touchresult {
 // Initialize the graphics system.
 void ui_init();
 void ui_final();
+// Start loading fonts, framebuffer and bitmaps in the background, as soon
+// as the UI may be shown; ui_init() then waits for what is missing.
+void ui_preload();
+// the UI won't be shown after ui_preload(), release what it loaded
+void ui_preload_drop();
 
 void evt_init();
 void evt_exit();
@@ -73,6 +78,11 @@ void evt_exit();
 // Stop/resume redraw thread
 void ui_stop_redraw(void);
 void ui_resume_redraw(void);
+// Release the whole UI footprint before exec'ing something big, it is
+// restored by the next ui_show_text(ENABLE), ui_start_menu() or
+// ui_wait_input(), ui_resume_redraw() only restarts the redraw thread.
+// Returns the bytes released.
+size_t ui_handoff(void);
 
 // Use KEY_* codes from <linux/input.h> or KEY_DREAM_* from "minui/minui.h".
 int ui_wait_key();            // waits for a key/button press, returns the code
@@ -82,6 +92,17 @@ int ui_text_visible();        // returns >0 if text log is currently visible
 void ui_show_text(int visible);
 void ui_clear_key_queue();
 
+// Key queue filled by the input thread. Consecutive touch drags waiting
+// in it are coalesced into the newest one.
+struct ui_queue_stats {
+  unsigned depth;       // events waiting now
+  unsigned max_depth;
+  unsigned queued;
+  unsigned coalesced;   // drags replaced by a newer position
+  unsigned dropped;     // the queue was full
+};
+void ui_get_queue_stats(struct ui_queue_stats *st);
+
 // Write a message to the on-screen log shown with Alt-L (also to stderr).
 // The screen is small, and users may need to report these messages to support,
 // so keep the output short and not too cryptic.
@@ -99,6 +120,9 @@ int ui_menu_select(int sel);
 // End menu mode, resetting the text overlay so that ui_print()
 // statements will be displayed.
 void ui_end_menu();
+// The last frame shown of the menu started with these headers is saved
+// when the UI exits, and shown at the next start until the UI is ready.
+void ui_set_splash_menu(char** headers);
 
 struct UiMenuItem buildMenuItem(int type, char *title, char *description);
 
@@ -556,6 +556,7 @@ int show_menu_recovery(void) {
       ui_print("This can take a couple of seconds.\n");
       ui_show_text(DISABLE);
       ui_stop_redraw();
+      ui_handoff();
       status = exec_script(FILE_CUSTOMRECOVERY, ENABLE, NULL);
       ui_resume_redraw();
       ui_show_text(ENABLE);
@@ -568,6 +569,7 @@ int show_menu_recovery(void) {
       ui_print("This can take a couple of seconds.\n");
       ui_show_text(DISABLE);
       ui_stop_redraw();
+      ui_handoff();
       status = exec_script(FILE_STABLERECOVERY, ENABLE, NULL);
       ui_resume_redraw();
       ui_show_text(ENABLE);
@@ -672,9 +674,10 @@ int exec_multiboot_recovery(char* file) {
 		ui_print("Starting Recovery..\n");
 		ui_print("This can take a couple of seconds.\n");
 
-		// pause UI
+		// pause UI, and release its memory for recovery
 		ui_show_text(DISABLE);
 		ui_stop_redraw();
+		ui_handoff();
 
 		args = malloc(sizeof(char*) * 3);
 		args[0] = file;
@@ -891,6 +894,8 @@ int snd_init(int ui) {
   exec_script(FILE_MULTIBOOT_BOOTMENUEXIT, ui, NULL);
   
   ui_stop_redraw();
+  // give the script the memory of the UI, it comes back if we return
+  ui_handoff();
 #ifdef USE_DUALCORE_DIRTY_HACK
     if(!ui)
       status = snd_exec_script(FILE_2NDINIT, ui, NULL);
@@ -943,6 +948,8 @@ int snd_boot(int ui) {
   exec_script(FILE_MULTIBOOT_BOOTMENUEXIT, ui, NULL);
   
   ui_stop_redraw();
+  // give the script the memory of the UI, it comes back if we return
+  ui_handoff();
 #ifdef USE_DUALCORE_DIRTY_HACK
     if(!ui)
       status = snd_exec_script(FILE_2NDBOOT, ui, NULL);
@@ -1022,6 +1029,8 @@ int snd_system(int ui) {
   set_lastmbsystem(args[0]);
 
   ui_stop_redraw();
+  // give the script the memory of the UI, it comes back if we return
+  ui_handoff();
 #ifdef USE_DUALCORE_DIRTY_HACK
     if(!ui)
       status = snd_exec_script(FILE_2NDSYSTEM, ui, args);
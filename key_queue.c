@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "common.h"
+#include "key_queue.h"
+
+/* head and tail count events, the slot of n being n % KEY_QUEUE_SIZE. */
+enum { SLOT_FREE, SLOT_QUEUED, SLOT_READING, SLOT_WRITING };
+
+static struct {
+  volatile int state;           // SLOT_*, taken with a CAS
+  struct ui_input_event ev;
+} key_queue[KEY_QUEUE_SIZE];
+static volatile unsigned key_queue_head = 0;    // next to read
+static volatile unsigned key_queue_tail = 0;    // next to write
+// futex bumped at each event queued, waited on when empty
+static volatile int key_queue_futex = 0;
+static volatile int key_queue_sleeping = 0;
+static struct ui_queue_stats key_queue_stats;   // written by the input thread
+
+// input thread side
+void key_queue_push(const struct ui_input_event *uev)
+{
+  unsigned tail = key_queue_tail;
+  unsigned depth;
+
+  // a drag not read yet is only replaced by the newest position
+  if (uev->utype == UINPUTEVENT_TYPE_TOUCH_DRAG && tail != key_queue_head) {
+    int slot = (tail - 1) % KEY_QUEUE_SIZE;
+    if (__sync_bool_compare_and_swap(&key_queue[slot].state, SLOT_QUEUED, SLOT_WRITING)) {
+      int drag = key_queue[slot].ev.utype == UINPUTEVENT_TYPE_TOUCH_DRAG;
+      if (drag)
+        key_queue[slot].ev = *uev;
+      __sync_synchronize();
+      key_queue[slot].state = SLOT_QUEUED;
+      if (drag) {
+        key_queue_stats.coalesced++;
+        return;
+      }
+    }
+  }
+
+  depth = tail - key_queue_head;
+  if (depth >= KEY_QUEUE_SIZE) {
+    key_queue_stats.dropped++;
+    return;
+  }
+  key_queue[tail % KEY_QUEUE_SIZE].ev = *uev;
+  key_queue[tail % KEY_QUEUE_SIZE].state = SLOT_QUEUED;
+  __sync_synchronize();
+  key_queue_tail = tail + 1;
+  key_queue_stats.queued++;
+  if (depth + 1 > key_queue_stats.max_depth)
+    key_queue_stats.max_depth = depth + 1;
+
+  __sync_fetch_and_add(&key_queue_futex, 1);
+  if (key_queue_sleeping)
+    syscall(__NR_futex, &key_queue_futex, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// menu code side, returns -1 if empty
+int key_queue_pop(struct ui_input_event *uev)
+{
+  unsigned head = key_queue_head;
+  int slot = head % KEY_QUEUE_SIZE;
+
+  __sync_synchronize();
+  if (head == key_queue_tail)
+    return -1;
+  // being coalesced, for the time of a copy
+  while (!__sync_bool_compare_and_swap(&key_queue[slot].state, SLOT_QUEUED, SLOT_READING))
+    sched_yield();
+  if (uev)
+    *uev = key_queue[slot].ev;
+  key_queue[slot].state = SLOT_FREE;
+  __sync_synchronize();
+  key_queue_head = head + 1;
+  return 0;
+}
+
+void key_queue_wait(void)
+{
+  int seq = key_queue_futex;
+
+  // seen by key_queue_push() if it queued after the check below
+  key_queue_sleeping = 1;
+  __sync_synchronize();
+  if (key_queue_head == key_queue_tail)
+    syscall(__NR_futex, &key_queue_futex, FUTEX_WAIT, seq, NULL, NULL, 0);
+  key_queue_sleeping = 0;
+}
+
+void key_queue_get_stats(struct ui_queue_stats *st)
+{
+  *st = key_queue_stats;
+  st->depth = key_queue_tail - key_queue_head;
+}
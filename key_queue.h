@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BOOTMENU_KEY_QUEUE_H
+#define BOOTMENU_KEY_QUEUE_H
+
+#include "common.h"
+
+/*
+ * Key event input queue: a ring filled by the input thread only, and
+ * emptied by the menu code only, without locks. A touch drag not read
+ * yet is replaced by the next one. When full, new events are dropped.
+ */
+#define KEY_QUEUE_SIZE 256
+
+// input thread side
+void key_queue_push(const struct ui_input_event *uev);
+
+// menu code side, returns -1 if empty, uev may be NULL to discard
+int key_queue_pop(struct ui_input_event *uev);
+// sleeps until an event is queued (returns at once if one is there)
+void key_queue_wait(void);
+
+void key_queue_get_stats(struct ui_queue_stats *st);
+
+#endif
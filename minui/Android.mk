@@ -4,9 +4,20 @@ LOCAL_PATH := $(call my-dir)
 
 include $(CLEAR_VARS)
 
-LOCAL_SRC_FILES := events.c resources.c
+LOCAL_SRC_FILES := events.c resources.c qoi.c glyph_cache.c fb_mem.c bands.c arena.c
 
-ifneq ($(BOARD_CUSTOM_BOOTMENU_GRAPHICS),)
+# fill/blit kernels, with NEON when the cpu has it
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+  LOCAL_SRC_FILES += blitter.c.neon
+else
+  LOCAL_SRC_FILES += blitter.c
+endif
+
+# "headless" renders into memory (MINUI_FB=fb0 still selects the real fb)
+ifeq ($(BOARD_CUSTOM_BOOTMENU_GRAPHICS),headless)
+  LOCAL_SRC_FILES += graphics.c
+  LOCAL_CFLAGS += -DBOARD_BOOTMENU_HEADLESS
+else ifneq ($(BOARD_CUSTOM_BOOTMENU_GRAPHICS),)
   LOCAL_SRC_FILES += $(BOARD_CUSTOM_BOOTMENU_GRAPHICS)
 else
   LOCAL_SRC_FILES += graphics.c
@@ -19,7 +30,8 @@ LOCAL_C_INCLUDES +=\
 LOCAL_MODULE := libminui_bm
 LOCAL_MODULE_TAGS := eng debug
 
-# Defy use this :
+# The panel's current mode is used when minui can draw it, else fb0 is
+# switched to this format. Defy use this :
 ifeq ($(TARGET_RECOVERY_PIXEL_FORMAT),"BGRA_8888")
     LOCAL_CFLAGS += -DPIXELS_BGRA
 endif
@@ -36,11 +48,91 @@ ifeq ($(TARGET_RECOVERY_PIXEL_FORMAT),"RGB_565")
     LOCAL_CFLAGS += -DPIXELS_RGB565
 endif
 
-# Reversed 16bits RGB (ics software gralloc)
+# Reversed 16bits RGB (ics software gralloc), red and blue are swapped
+# whatever offsets fb0 reports
 #LOCAL_CFLAGS += -DPIXELS_BGR_16BPP
 
+# Draw 32bpp panels in an RGB 565 surface, expanded to the page on flip
+ifeq ($(BOARD_BOOTMENU_RENDER_16BPP),true)
+    LOCAL_CFLAGS += -DBOARD_BOOTMENU_RENDER_16BPP
+endif
+
+# Decode opaque images to RGB 565 without ordered dithering
+ifeq ($(BOARD_BOOTMENU_NO_DITHER),true)
+    LOCAL_CFLAGS += -DBOARD_BOOTMENU_NO_DITHER
+endif
+
+# Only load images converted with mkqoi, libpng is then left out
+ifeq ($(BOARD_BOOTMENU_NO_PNG),true)
+    LOCAL_CFLAGS += -DBOARD_BOOTMENU_NO_PNG
+endif
+
+# Always switch fb0 to the format above, even if its mode is usable
+ifeq ($(BOARD_BOOTMENU_FORCE_PIXELS),true)
+    LOCAL_CFLAGS += -DBOARD_BOOTMENU_FORCE_PIXELS
+endif
+
+# Always render off-screen and copy on flip, even with two fb pages
+ifeq ($(BOARD_BOOTMENU_FLIP_COPY),true)
+    LOCAL_CFLAGS += -DBOARD_BOOTMENU_FLIP_COPY
+endif
+
+# Wait for vsync after each page flip (FBIO_WAITFORVSYNC)
+ifeq ($(BOARD_BOOTMENU_WAIT_VSYNC),true)
+    LOCAL_CFLAGS += -DBOARD_BOOTMENU_WAIT_VSYNC
+endif
+
+# Input devices kept or closed whatever they can send, comma separated
+# names (default deny: bma250,accelerometer)
+ifneq ($(BOARD_BOOTMENU_INPUT_ALLOW),)
+    LOCAL_CFLAGS += -DBOARD_BOOTMENU_INPUT_ALLOW=\"$(BOARD_BOOTMENU_INPUT_ALLOW)\"
+endif
+ifneq ($(BOARD_BOOTMENU_INPUT_DENY),)
+    LOCAL_CFLAGS += -DBOARD_BOOTMENU_INPUT_DENY=\"$(BOARD_BOOTMENU_INPUT_DENY)\"
+endif
+
+# Split full redraws in horizontal bands drawn by one thread each
+ifeq ($(TARGET_CPU_SMP),true)
+    BOARD_BOOTMENU_BANDS ?= 2
+endif
+ifneq ($(BOARD_BOOTMENU_BANDS),)
+    LOCAL_CFLAGS += -DBOARD_BOOTMENU_BANDS=$(BOARD_BOOTMENU_BANDS)
+endif
+
 include $(BUILD_STATIC_LIBRARY)
 
+# Graphics benchmark (not installed by default), see gr_bench.c for usage
+include $(CLEAR_VARS)
+LOCAL_MODULE := bm_grbench
+LOCAL_MODULE_STEM := grbench
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := gr_bench.c
+LOCAL_STATIC_LIBRARIES := libminui_bm libpixelflinger_static libpng libz
+LOCAL_STATIC_LIBRARIES += libstdc++ libc libcutils
+LOCAL_FORCE_STATIC_EXECUTABLE := true
+LOCAL_MODULE_PATH := $(PRODUCT_OUT)/system/bootmenu/binary
+include $(BUILD_EXECUTABLE)
+
+# Host converter of images/*.png to the QOI files minui prefers
+include $(CLEAR_VARS)
+LOCAL_MODULE := bm_mkqoi
+LOCAL_MODULE_STEM := mkqoi
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := mkqoi.c qoi.c
+LOCAL_C_INCLUDES += external/libpng external/zlib
+LOCAL_STATIC_LIBRARIES := libpng libz
+include $(BUILD_HOST_EXECUTABLE)
+
+# Host stress test of the bootmenu key queue, see kq_stress.c
+include $(CLEAR_VARS)
+LOCAL_MODULE := bm_kqstress
+LOCAL_MODULE_STEM := kqstress
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := kq_stress.c ../key_queue.c
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/..
+LOCAL_LDLIBS := -lpthread
+include $(BUILD_HOST_EXECUTABLE)
+
 #include $(CLEAR_VARS)
 #LOCAL_MODULE := bm_mkfont
 #LOCAL_MODULE_STEM := mkfont
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "minui.h"
+
+#define ARENA_MAGIC 0x4152454e /* "AREN" */
+
+/* Every block starts with this header, linked in its arena. Mappings get
+ * a separate header pointing to them. */
+struct arena_block {
+    struct arena_block *prev;
+    struct arena_block *next;
+    size_t size;
+    void *map;          // mapping, NULL for heap blocks
+    unsigned magic;
+};
+
+// keeps the data after the header aligned for the blitter kernels
+#define ARENA_HEADER ((sizeof(struct arena_block) + 15) & ~(size_t) 15)
+
+struct arena gr_arena = ARENA_INIT("minui");
+
+static inline void *arena_data(struct arena_block *b)
+{
+    return (char *) b + ARENA_HEADER;
+}
+
+static inline struct arena_block *arena_block(void *p)
+{
+    return (struct arena_block *) ((char *) p - ARENA_HEADER);
+}
+
+// with a->lock held
+static void arena_link(struct arena *a, struct arena_block *b, size_t size)
+{
+    b->prev = NULL;
+    b->next = a->blocks;
+    if (a->blocks)
+        a->blocks->prev = b;
+    a->blocks = b;
+    b->size = size;
+    b->magic = ARENA_MAGIC;
+    a->count++;
+    a->bytes += size;
+    if (a->bytes > a->peak)
+        a->peak = a->bytes;
+}
+
+static void arena_unlink(struct arena *a, struct arena_block *b)
+{
+    if (b->prev)
+        b->prev->next = b->next;
+    else
+        a->blocks = b->next;
+    if (b->next)
+        b->next->prev = b->prev;
+    b->magic = 0;
+    a->count--;
+    a->bytes -= b->size;
+}
+
+static int arena_check(struct arena *a, struct arena_block *b)
+{
+    if (b->magic == ARENA_MAGIC && b->map == NULL)
+        return 0;
+    fprintf(stderr, "arena %s: %p was not allocated here\n", a->name, arena_data(b));
+    return -1;
+}
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+    struct arena_block *b = malloc(ARENA_HEADER + size);
+
+    if (b == NULL)
+        return NULL;
+    b->map = NULL;
+    pthread_mutex_lock(&a->lock);
+    arena_link(a, b, size);
+    pthread_mutex_unlock(&a->lock);
+    return arena_data(b);
+}
+
+void *arena_calloc(struct arena *a, size_t size)
+{
+    void *p = arena_alloc(a, size);
+
+    if (p)
+        memset(p, 0, size);
+    return p;
+}
+
+void *arena_realloc(struct arena *a, void *p, size_t size)
+{
+    struct arena_block *b, *nb;
+
+    if (p == NULL)
+        return arena_alloc(a, size);
+
+    b = arena_block(p);
+    pthread_mutex_lock(&a->lock);
+    if (arena_check(a, b) < 0) {
+        pthread_mutex_unlock(&a->lock);
+        return NULL;
+    }
+    // the block can move, relink it around the realloc
+    arena_unlink(a, b);
+    nb = realloc(b, ARENA_HEADER + size);
+    if (nb == NULL) {
+        arena_link(a, b, b->size);
+        pthread_mutex_unlock(&a->lock);
+        return NULL;
+    }
+    arena_link(a, nb, size);
+    pthread_mutex_unlock(&a->lock);
+    return arena_data(nb);
+}
+
+void arena_free(struct arena *a, void *p)
+{
+    struct arena_block *b;
+
+    if (p == NULL)
+        return;
+    b = arena_block(p);
+    pthread_mutex_lock(&a->lock);
+    if (arena_check(a, b) < 0) {
+        pthread_mutex_unlock(&a->lock);
+        return;
+    }
+    arena_unlink(a, b);
+    pthread_mutex_unlock(&a->lock);
+    free(b);
+}
+
+void *arena_mmap(struct arena *a, size_t len, int prot, int flags, int fd)
+{
+    struct arena_block *b = malloc(sizeof(*b));
+    void *map;
+
+    if (b == NULL)
+        return MAP_FAILED;
+    map = mmap(NULL, len, prot, flags, fd, 0);
+    if (map == MAP_FAILED) {
+        free(b);
+        return MAP_FAILED;
+    }
+    b->map = map;
+    pthread_mutex_lock(&a->lock);
+    arena_link(a, b, len);
+    pthread_mutex_unlock(&a->lock);
+    return map;
+}
+
+void arena_unmap(struct arena *a, void *map)
+{
+    struct arena_block *b;
+
+    pthread_mutex_lock(&a->lock);
+    for (b = a->blocks; b; b = b->next) {
+        if (b->map == map)
+            break;
+    }
+    if (b == NULL) {
+        pthread_mutex_unlock(&a->lock);
+        fprintf(stderr, "arena %s: %p was not mapped here\n", a->name, map);
+        return;
+    }
+    arena_unlink(a, b);
+    pthread_mutex_unlock(&a->lock);
+    munmap(b->map, b->size);
+    free(b);
+}
+
+size_t arena_bytes(struct arena *a)
+{
+    size_t bytes;
+
+    pthread_mutex_lock(&a->lock);
+    bytes = a->bytes;
+    pthread_mutex_unlock(&a->lock);
+    return bytes;
+}
+
+size_t arena_release(struct arena *a)
+{
+    struct arena_block *b, *next;
+    size_t bytes;
+
+    pthread_mutex_lock(&a->lock);
+    b = a->blocks;
+    bytes = a->bytes;
+    a->blocks = NULL;
+    a->count = 0;
+    a->bytes = 0;
+    pthread_mutex_unlock(&a->lock);
+
+    for (; b; b = next) {
+        next = b->next;
+        b->magic = 0;
+        if (b->map)
+            munmap(b->map, b->size);
+        free(b);
+    }
+    return bytes;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "bands.h"
+
+static pthread_t bands_threads[BANDS_MAX];
+static int bands_count = 1;
+
+static pthread_mutex_t bands_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bands_go = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t bands_done = PTHREAD_COND_INITIALIZER;
+
+// current job, a new one is posted by bumping bands_gen
+static void (*bands_fn)(void *arg, int band);
+static void *bands_arg;
+static unsigned bands_gen = 0, bands_base_gen = 0;
+static int bands_pending = 0;
+static int bands_quit = 0;
+
+static void *bands_worker(void *cookie)
+{
+    int band = (int) (long) cookie;
+    unsigned gen = bands_base_gen;
+
+    pthread_mutex_lock(&bands_mutex);
+    for (;;) {
+        while (bands_gen == gen && !bands_quit)
+            pthread_cond_wait(&bands_go, &bands_mutex);
+        if (bands_quit)
+            break;
+        gen = bands_gen;
+        pthread_mutex_unlock(&bands_mutex);
+
+        bands_fn(bands_arg, band);
+
+        pthread_mutex_lock(&bands_mutex);
+        if (--bands_pending == 0)
+            pthread_cond_signal(&bands_done);
+    }
+    pthread_mutex_unlock(&bands_mutex);
+    return NULL;
+}
+
+int bands_start(int n)
+{
+    int i;
+
+    bands_stop();
+    if (n > BANDS_MAX) n = BANDS_MAX;
+
+    bands_quit = 0;
+    bands_base_gen = bands_gen;
+    for (i = 1; i < n; i++) {
+        if (pthread_create(&bands_threads[i], NULL, bands_worker, (void*) (long) i)) {
+            perror("bands: pthread_create");
+            break;
+        }
+        bands_count = i + 1;
+    }
+    return bands_count;
+}
+
+void bands_stop(void)
+{
+    int i;
+
+    if (bands_count == 1)
+        return;
+
+    pthread_mutex_lock(&bands_mutex);
+    bands_quit = 1;
+    pthread_cond_broadcast(&bands_go);
+    pthread_mutex_unlock(&bands_mutex);
+
+    for (i = 1; i < bands_count; i++)
+        pthread_join(bands_threads[i], NULL);
+    bands_count = 1;
+}
+
+void bands_run(void (*fn)(void *arg, int band), void *arg)
+{
+    if (bands_count > 1) {
+        pthread_mutex_lock(&bands_mutex);
+        bands_fn = fn;
+        bands_arg = arg;
+        bands_pending = bands_count - 1;
+        bands_gen++;
+        pthread_cond_broadcast(&bands_go);
+        pthread_mutex_unlock(&bands_mutex);
+    }
+
+    fn(arg, 0);
+
+    if (bands_count > 1) {
+        pthread_mutex_lock(&bands_mutex);
+        while (bands_pending)
+            pthread_cond_wait(&bands_done, &bands_mutex);
+        pthread_mutex_unlock(&bands_mutex);
+    }
+}
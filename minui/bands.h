@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _MINUI_BANDS_H_
+#define _MINUI_BANDS_H_
+
+/*
+ * A small pool of threads running one job on n horizontal bands of a
+ * frame. Band 0 is run by the caller, bands 1 .. n-1 by the workers.
+ */
+#define BANDS_MAX 8
+
+// starts n - 1 workers (stopping the previous ones), returns the number
+// of bands that can be run, 1 if no worker could be started
+int bands_start(int n);
+void bands_stop(void);
+
+// runs fn(arg, band) for every band and waits for all of them
+void bands_run(void (*fn)(void *arg, int band), void *arg);
+
+#endif
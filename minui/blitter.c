@@ -0,0 +1,597 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <pixelflinger/pixelflinger.h>
+
+#if defined(__ARM_NEON__)
+# include <arm_neon.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#include "blitter.h"
+
+/* (x + 128 + ((x + 128) >> 8)) >> 8 is x / 255 rounded, for x <= 255*255 */
+static inline unsigned div255(unsigned x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static inline int is_8888(int format)
+{
+    return format == GGL_PIXEL_FORMAT_RGBA_8888
+        || format == GGL_PIXEL_FORMAT_RGBX_8888
+        || format == GGL_PIXEL_FORMAT_BGRA_8888;
+}
+
+// red in the low byte (RGBA/RGBX) or in the third one (BGRA)
+static inline int red_first(int format)
+{
+    return format != GGL_PIXEL_FORMAT_BGRA_8888;
+}
+
+static inline int has_alpha(int format)
+{
+    return format == GGL_PIXEL_FORMAT_RGBA_8888
+        || format == GGL_PIXEL_FORMAT_BGRA_8888;
+}
+
+static inline uint32_t swap_rb(uint32_t p)
+{
+    return (p & 0xff00ff00) | ((p >> 16) & 0xff) | ((p & 0xff) << 16);
+}
+
+/*****************************************************************************/
+/* row kernels */
+
+static void row_fill16(uint16_t *d, uint16_t v, int n)
+{
+#if defined(__ARM_NEON__)
+    uint16x8_t vv = vdupq_n_u16(v);
+    for (; n >= 8; n -= 8, d += 8)
+        vst1q_u16(d, vv);
+#elif defined(__SSE2__)
+    __m128i vv = _mm_set1_epi16(v);
+    for (; n >= 8; n -= 8, d += 8)
+        _mm_storeu_si128((__m128i*) d, vv);
+#endif
+    while (n-- > 0)
+        *d++ = v;
+}
+
+static void row_fill32(uint32_t *d, uint32_t v, int n)
+{
+#if defined(__ARM_NEON__)
+    uint32x4_t vv = vdupq_n_u32(v);
+    for (; n >= 4; n -= 4, d += 4)
+        vst1q_u32(d, vv);
+#elif defined(__SSE2__)
+    __m128i vv = _mm_set1_epi32(v);
+    for (; n >= 4; n -= 4, d += 4)
+        _mm_storeu_si128((__m128i*) d, vv);
+#endif
+    while (n-- > 0)
+        *d++ = v;
+}
+
+/* d = v * a + d * (1 - a), v is opaque in the destination layout */
+static void row_blend32(uint32_t *d, uint32_t v, unsigned a, int n)
+{
+    unsigned ia = 255 - a;
+    unsigned c0 = (v & 0xff) * a, c1 = ((v >> 8) & 0xff) * a;
+    unsigned c2 = ((v >> 16) & 0xff) * a, c3 = (v >> 24) * a;
+
+#if defined(__ARM_NEON__)
+    uint8x8_t via = vdup_n_u8(ia);
+    uint16x8_t vc0 = vdupq_n_u16(c0), vc1 = vdupq_n_u16(c1);
+    uint16x8_t vc2 = vdupq_n_u16(c2), vc3 = vdupq_n_u16(c3);
+    for (; n >= 8; n -= 8, d += 8) {
+        uint8x8x4_t px = vld4_u8((uint8_t*) d);
+        uint16x8_t t;
+        t = vmlal_u8(vc0, px.val[0], via);
+        px.val[0] = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+        t = vmlal_u8(vc1, px.val[1], via);
+        px.val[1] = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+        t = vmlal_u8(vc2, px.val[2], via);
+        px.val[2] = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+        t = vmlal_u8(vc3, px.val[3], via);
+        px.val[3] = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+        vst4_u8((uint8_t*) d, px);
+    }
+#elif defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i vr = _mm_set1_epi16(128);
+    __m128i via = _mm_set1_epi16(ia);
+    __m128i vc = _mm_set_epi16(c3, c2, c1, c0, c3, c2, c1, c0);
+    for (; n >= 4; n -= 4, d += 4) {
+        __m128i px = _mm_loadu_si128((__m128i*) d);
+        __m128i lo = _mm_unpacklo_epi8(px, zero);
+        __m128i hi = _mm_unpackhi_epi8(px, zero);
+        lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, via), vc), vr);
+        hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, via), vc), vr);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        _mm_storeu_si128((__m128i*) d, _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; n > 0; n--, d++) {
+        uint32_t p = *d;
+        *d = div255(c0 + (p & 0xff) * ia)
+           | div255(c1 + ((p >> 8) & 0xff) * ia) << 8
+           | div255(c2 + ((p >> 16) & 0xff) * ia) << 16
+           | div255(c3 + (p >> 24) * ia) << 24;
+    }
+}
+
+/* 565 channels spread apart, so they can be scaled in one multiply */
+static inline uint32_t spread565(uint32_t p)
+{
+    return (p | (p << 16)) & 0x07e0f81f;
+}
+
+static void row_blend16(uint16_t *d, uint16_t v, unsigned a, int n)
+{
+    unsigned a5 = (a + 4) >> 3;
+    uint32_t sv = spread565(v) * a5;
+
+    // the same per channel, 8 pixels at a time
+#if defined(__ARM_NEON__)
+    uint16x8_t vr = vdupq_n_u16((v >> 11) * a5), vg = vdupq_n_u16(((v >> 5) & 0x3f) * a5);
+    uint16x8_t vb = vdupq_n_u16((v & 0x1f) * a5), ia = vdupq_n_u16(32 - a5);
+    uint16x8_t m5 = vdupq_n_u16(0x1f), m6 = vdupq_n_u16(0x3f);
+
+    for (; n >= 8; n -= 8, d += 8) {
+        uint16x8_t p = vld1q_u16(d);
+        uint16x8_t r = vshrq_n_u16(vmlaq_u16(vr, vshrq_n_u16(p, 11), ia), 5);
+        uint16x8_t g = vshrq_n_u16(vmlaq_u16(vg, vandq_u16(vshrq_n_u16(p, 5), m6), ia), 5);
+        uint16x8_t b = vshrq_n_u16(vmlaq_u16(vb, vandq_u16(p, m5), ia), 5);
+        vst1q_u16(d, vorrq_u16(vorrq_u16(vshlq_n_u16(r, 11), vshlq_n_u16(g, 5)), b));
+    }
+#elif defined(__SSE2__)
+    __m128i vr = _mm_set1_epi16((v >> 11) * a5), vg = _mm_set1_epi16(((v >> 5) & 0x3f) * a5);
+    __m128i vb = _mm_set1_epi16((v & 0x1f) * a5), ia = _mm_set1_epi16(32 - a5);
+    __m128i m5 = _mm_set1_epi16(0x1f), m6 = _mm_set1_epi16(0x3f);
+
+    for (; n >= 8; n -= 8, d += 8) {
+        __m128i p = _mm_loadu_si128((const __m128i*) d);
+        __m128i r = _mm_mullo_epi16(_mm_srli_epi16(p, 11), ia);
+        __m128i g = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(p, 5), m6), ia);
+        __m128i b = _mm_mullo_epi16(_mm_and_si128(p, m5), ia);
+        r = _mm_srli_epi16(_mm_add_epi16(r, vr), 5);
+        g = _mm_srli_epi16(_mm_add_epi16(g, vg), 5);
+        b = _mm_srli_epi16(_mm_add_epi16(b, vb), 5);
+        p = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(r, 11), _mm_slli_epi16(g, 5)), b);
+        _mm_storeu_si128((__m128i*) d, p);
+    }
+#endif
+    for (; n > 0; n--, d++) {
+        uint32_t p = ((sv + spread565(*d) * (32 - a5)) >> 5) & 0x07e0f81f;
+        *d = (uint16_t) (p | (p >> 16));
+    }
+}
+
+/* source-over of 8888 with alpha onto 565, same math as row_blend16 */
+static void row_over32_565(uint16_t *d, const uint32_t *s, int n, int red_first)
+{
+    for (; n > 0; n--, d++, s++) {
+        uint32_t c = *s;
+        unsigned a = c >> 24, a5;
+        unsigned r = red_first ? c & 0xff : (c >> 16) & 0xff;
+        unsigned b = red_first ? (c >> 16) & 0xff : c & 0xff;
+        uint32_t v = ((r >> 3) << 11) | ((((c >> 8) & 0xff) >> 2) << 5) | (b >> 3);
+
+        if (a == 0)
+            continue;
+        if (a == 255) {
+            *d = v;
+            continue;
+        }
+        a5 = (a + 4) >> 3;
+        v = ((spread565(v) * a5 + spread565(*d) * (32 - a5)) >> 5) & 0x07e0f81f;
+        *d = (uint16_t) (v | (v >> 16));
+    }
+}
+
+/* 8888 without alpha to 565, truncated like in row_over32_565 */
+static void row_copy32_565(uint16_t *d, const uint32_t *s, int n, int red_first)
+{
+    for (; n > 0; n--, d++, s++) {
+        uint32_t c = *s;
+        unsigned r = red_first ? c & 0xff : (c >> 16) & 0xff;
+        unsigned b = red_first ? (c >> 16) & 0xff : c & 0xff;
+        *d = ((r >> 3) << 11) | ((((c >> 8) & 0xff) >> 2) << 5) | (b >> 3);
+    }
+}
+
+/* 565 to opaque 8888, channels widened by replicating their top bits */
+static inline uint32_t expand565(uint32_t p, int red_first)
+{
+    unsigned r = (p >> 11) & 0x1f, g = (p >> 5) & 0x3f, b = p & 0x1f;
+
+    r = (r << 3) | (r >> 2);
+    g = (g << 2) | (g >> 4);
+    b = (b << 3) | (b >> 2);
+    return red_first ? 0xff000000 | (b << 16) | (g << 8) | r
+                     : 0xff000000 | (r << 16) | (g << 8) | b;
+}
+
+static void row_expand565(uint32_t *d, const uint16_t *s, int n, int red_first)
+{
+#if defined(__ARM_NEON__)
+    for (; n >= 8; n -= 8, d += 8, s += 8) {
+        uint16x8_t p = vld1q_u16(s);
+        uint8x8_t r = vand_u8(vshrn_n_u16(p, 8), vdup_n_u8(0xf8));
+        uint8x8_t g = vand_u8(vshrn_n_u16(p, 3), vdup_n_u8(0xfc));
+        uint8x8_t b = vmovn_u16(vshlq_n_u16(p, 3));
+        uint8x8x4_t q;
+
+        r = vorr_u8(r, vshr_n_u8(r, 5));
+        g = vorr_u8(g, vshr_n_u8(g, 6));
+        b = vorr_u8(b, vshr_n_u8(b, 5));
+        q.val[0] = red_first ? r : b;
+        q.val[1] = g;
+        q.val[2] = red_first ? b : r;
+        q.val[3] = vdup_n_u8(0xff);
+        vst4_u8((uint8_t*) d, q);
+    }
+#elif defined(__SSE2__)
+    const __m128i m5 = _mm_set1_epi16(0x1f), m6 = _mm_set1_epi16(0x3f);
+    const __m128i alpha = _mm_set1_epi16((short) 0xff00);
+
+    for (; n >= 8; n -= 8, d += 8, s += 8) {
+        __m128i p = _mm_loadu_si128((const __m128i*) s);
+        __m128i r = _mm_srli_epi16(p, 11);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(p, 5), m6);
+        __m128i b = _mm_and_si128(p, m5);
+        __m128i lo, hi;
+
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+        // low half of each pixel is the first channel and green
+        lo = _mm_or_si128(red_first ? r : b, _mm_slli_epi16(g, 8));
+        hi = _mm_or_si128(red_first ? b : r, alpha);
+        _mm_storeu_si128((__m128i*) d, _mm_unpacklo_epi16(lo, hi));
+        _mm_storeu_si128((__m128i*) (d + 4), _mm_unpackhi_epi16(lo, hi));
+    }
+#endif
+    for (; n > 0; n--)
+        *d++ = expand565(*s++, red_first);
+}
+
+static inline uint32_t over_pixel(uint32_t s, uint32_t p)
+{
+    unsigned a = s >> 24, ia = 255 - a;
+
+    if (a == 255) return s;
+    if (a == 0) return p;
+    return div255((s & 0xff) * a + (p & 0xff) * ia)
+         | div255(((s >> 8) & 0xff) * a + ((p >> 8) & 0xff) * ia) << 8
+         | div255(((s >> 16) & 0xff) * a + ((p >> 16) & 0xff) * ia) << 16
+         | div255((s >> 24) * a + (p >> 24) * ia) << 24;
+}
+
+/* source-over with the source alpha in the high byte (RGBA and BGRA) */
+static void row_over32(uint32_t *d, const uint32_t *s, int n)
+{
+#if defined(__ARM_NEON__)
+    for (; n >= 8; n -= 8, d += 8, s += 8) {
+        uint8x8x4_t sp = vld4_u8((const uint8_t*) s);
+        uint8x8x4_t dp = vld4_u8((uint8_t*) d);
+        uint8x8_t a = sp.val[3], ia = vmvn_u8(a);
+        int k;
+        for (k = 0; k < 4; k++) {
+            uint16x8_t t = vmull_u8(sp.val[k], a);
+            t = vmlal_u8(t, dp.val[k], ia);
+            dp.val[k] = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+        }
+        vst4_u8((uint8_t*) d, dp);
+    }
+#elif defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i vr = _mm_set1_epi16(128);
+    __m128i v255 = _mm_set1_epi16(255);
+    for (; n >= 2; n -= 2, d += 2, s += 2) {
+        __m128i sp = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) s), zero);
+        __m128i dp = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) d), zero);
+        __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sp, 0xff), 0xff);
+        __m128i t = _mm_add_epi16(_mm_mullo_epi16(sp, a),
+                                  _mm_mullo_epi16(dp, _mm_sub_epi16(v255, a)));
+        t = _mm_add_epi16(t, vr);
+        t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        _mm_storel_epi64((__m128i*) d, _mm_packus_epi16(t, zero));
+    }
+#endif
+    for (; n > 0; n--, d++, s++)
+        *d = over_pixel(*s, *d);
+}
+
+static void row_copy32_swap(uint32_t *d, const uint32_t *s, int n)
+{
+    while (n-- > 0)
+        *d++ = swap_rb(*s++);
+}
+
+static void row_over32_swap(uint32_t *d, const uint32_t *s, int n)
+{
+    for (; n > 0; n--, d++, s++)
+        *d = over_pixel(swap_rb(*s), *d);
+}
+
+/*****************************************************************************/
+/* per-format kernels
+ *
+ * Every routine below is written once for a destination format given as
+ * a constant, BL_OPS() then instantiates it for each supported format so
+ * the format tests fold away, and bl_get_ops() hands out the table.
+ */
+
+#define BL_INLINE static inline __attribute__((always_inline))
+
+BL_INLINE unsigned pack_color(int format, unsigned char r, unsigned char g,
+                              unsigned char b, unsigned char a)
+{
+    switch (format) {
+    case GGL_PIXEL_FORMAT_RGB_565:
+        return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    case GGL_PIXEL_FORMAT_BGRA_8888:
+        return (a << 24) | (r << 16) | (g << 8) | b;
+    default:
+        return (a << 24) | (b << 16) | (g << 8) | r;
+    }
+}
+
+BL_INLINE void fill_rect(int format, GGLSurface *dst, int l, int t, int r, int b,
+                         unsigned pixel)
+{
+    int y, n = r - l;
+
+    if (format == GGL_PIXEL_FORMAT_RGB_565) {
+        uint16_t *row = (uint16_t*) dst->data + t * dst->stride + l;
+        for (y = t; y < b; y++, row += dst->stride)
+            row_fill16(row, pixel, n);
+    } else {
+        uint32_t *row = (uint32_t*) dst->data + t * dst->stride + l;
+        for (y = t; y < b; y++, row += dst->stride)
+            row_fill32(row, pixel, n);
+    }
+}
+
+BL_INLINE void fill_blend_rect(int format, GGLSurface *dst, int l, int t, int r, int b,
+                               unsigned char cr, unsigned char cg, unsigned char cb,
+                               unsigned char ca)
+{
+    int y, n = r - l;
+    unsigned v = pack_color(format, cr, cg, cb, 255);
+
+    if (ca == 0)
+        return;
+    if (ca == 255) {
+        fill_rect(format, dst, l, t, r, b, v);
+        return;
+    }
+
+    if (format == GGL_PIXEL_FORMAT_RGB_565) {
+        uint16_t *row = (uint16_t*) dst->data + t * dst->stride + l;
+        for (y = t; y < b; y++, row += dst->stride)
+            row_blend16(row, v, ca, n);
+    } else {
+        uint32_t *row = (uint32_t*) dst->data + t * dst->stride + l;
+        for (y = t; y < b; y++, row += dst->stride)
+            row_blend32(row, v, ca, n);
+    }
+}
+
+BL_INLINE int blit_rect(int format, GGLSurface *dst, int dx, int dy,
+                        const GGLSurface *src, int sx, int sy, int w, int h)
+{
+    int y;
+
+    if (format == GGL_PIXEL_FORMAT_RGB_565) {
+        uint16_t *d = (uint16_t*) dst->data + dy * dst->stride + dx;
+
+        if (src->format == GGL_PIXEL_FORMAT_RGB_565) {
+            const uint16_t *s = (const uint16_t*) src->data + sy * src->stride + sx;
+            for (y = 0; y < h; y++, d += dst->stride, s += src->stride)
+                memcpy(d, s, w * 2);
+            return 1;
+        }
+        if (is_8888(src->format)) {
+            const uint32_t *s = (const uint32_t*) src->data + sy * src->stride + sx;
+            for (y = 0; y < h; y++, d += dst->stride, s += src->stride) {
+                if (has_alpha(src->format))
+                    row_over32_565(d, s, w, red_first(src->format));
+                else
+                    row_copy32_565(d, s, w, red_first(src->format));
+            }
+            return 1;
+        }
+        return 0;
+    }
+
+    if (src->format == GGL_PIXEL_FORMAT_RGB_565) {
+        uint32_t *d = (uint32_t*) dst->data + dy * dst->stride + dx;
+        const uint16_t *s = (const uint16_t*) src->data + sy * src->stride + sx;
+        for (y = 0; y < h; y++, d += dst->stride, s += src->stride)
+            row_expand565(d, s, w, red_first(format));
+        return 1;
+    }
+
+    if (is_8888(src->format)) {
+        uint32_t *d = (uint32_t*) dst->data + dy * dst->stride + dx;
+        const uint32_t *s = (const uint32_t*) src->data + sy * src->stride + sx;
+        int swap = red_first(src->format) != red_first(format);
+        int blend = has_alpha(src->format);
+
+        for (y = 0; y < h; y++, d += dst->stride, s += src->stride) {
+            if (blend) {
+                if (swap) row_over32_swap(d, s, w);
+                else row_over32(d, s, w);
+            } else {
+                if (swap) row_copy32_swap(d, s, w);
+                else memcpy(d, s, w * 4);
+            }
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
+static inline uint32_t load_bits(const unsigned char *p, int n)
+{
+    switch (n) {
+    case 1: return p[0] << 24;
+    case 2: return (p[0] << 24) | (p[1] << 16);
+    case 3: return (p[0] << 24) | (p[1] << 16) | (p[2] << 8);
+    default: return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+}
+
+BL_INLINE void glyph1_rect(int format, GGLSurface *dst, int x, int y,
+                           const unsigned char *bits, int pitch, int w, int h,
+                           int l, int t, int r, int b, unsigned pixel)
+{
+    int bpp = (format == GGL_PIXEL_FORMAT_RGB_565) ? 2 : 4;
+    int y0 = t > y ? t - y : 0, y1 = b - y < h ? b - y : h;
+    int x0 = l > x ? l - x : 0, x1 = r - x < w ? r - x : w;
+    int row, c;
+
+    if (x0 >= x1)
+        return;
+
+    for (row = y0; row < y1; row++) {
+        const unsigned char *p = bits + row * pitch;
+        unsigned char *d = dst->data + ((y + row) * dst->stride + x) * bpp;
+
+        // 32 columns at a time, each run of set bits is one fill
+        for (c = x0 & ~31; c < x1; c += 32) {
+            int n = pitch - c / 8;
+            uint32_t word = load_bits(p + c / 8, n < 4 ? n : 4);
+
+            if (x0 > c)
+                word &= 0xffffffffu >> (x0 - c);
+            if (x1 - c < 32)
+                word &= ~(0xffffffffu >> (x1 - c));
+
+            while (word) {
+                int s = __builtin_clz(word);
+                uint32_t rest = ~(word << s);
+                int len = rest ? __builtin_clz(rest) : 32 - s;
+                int i;
+
+                if (bpp == 2) {
+                    uint16_t *q = (uint16_t*) d + c + s;
+                    for (i = 0; i < len; i++) q[i] = pixel;
+                } else {
+                    uint32_t *q = (uint32_t*) d + c + s;
+                    for (i = 0; i < len; i++) q[i] = pixel;
+                }
+                word &= (s + len >= 32) ? 0 : 0xffffffffu >> (s + len);
+            }
+        }
+    }
+}
+
+#define BL_OPS(name, FORMAT, BPP)                                               \
+static unsigned name##_pack(unsigned char r, unsigned char g,                  \
+                            unsigned char b, unsigned char a)                  \
+{                                                                              \
+    return pack_color(FORMAT, r, g, b, a);                                     \
+}                                                                              \
+static void name##_fill(GGLSurface *dst, int l, int t, int r, int b,           \
+                        unsigned pixel)                                        \
+{                                                                              \
+    fill_rect(FORMAT, dst, l, t, r, b, pixel);                                 \
+}                                                                              \
+static void name##_fill_blend(GGLSurface *dst, int l, int t, int r, int b,     \
+                              unsigned char cr, unsigned char cg,              \
+                              unsigned char cb, unsigned char ca)              \
+{                                                                              \
+    fill_blend_rect(FORMAT, dst, l, t, r, b, cr, cg, cb, ca);                  \
+}                                                                              \
+static int name##_blit(GGLSurface *dst, int dx, int dy, const GGLSurface *src, \
+                       int sx, int sy, int w, int h)                           \
+{                                                                              \
+    return blit_rect(FORMAT, dst, dx, dy, src, sx, sy, w, h);                  \
+}                                                                              \
+static void name##_glyph1(GGLSurface *dst, int x, int y,                       \
+                          const unsigned char *bits, int pitch, int w, int h,  \
+                          int l, int t, int r, int b, unsigned pixel)          \
+{                                                                              \
+    glyph1_rect(FORMAT, dst, x, y, bits, pitch, w, h, l, t, r, b, pixel);      \
+}                                                                              \
+static const struct bl_ops name##_ops = {                                      \
+    #name, FORMAT, BPP, name##_pack, name##_fill, name##_fill_blend,           \
+    name##_blit, name##_glyph1,                                                \
+};
+
+BL_OPS(rgb565, GGL_PIXEL_FORMAT_RGB_565,   2)
+BL_OPS(rgbx,   GGL_PIXEL_FORMAT_RGBX_8888, 4)
+BL_OPS(rgba,   GGL_PIXEL_FORMAT_RGBA_8888, 4)
+BL_OPS(bgra,   GGL_PIXEL_FORMAT_BGRA_8888, 4)
+
+const struct bl_ops *bl_get_ops(int format)
+{
+    switch (format) {
+    case GGL_PIXEL_FORMAT_RGB_565:   return &rgb565_ops;
+    case GGL_PIXEL_FORMAT_RGBX_8888: return &rgbx_ops;
+    case GGL_PIXEL_FORMAT_RGBA_8888: return &rgba_ops;
+    case GGL_PIXEL_FORMAT_BGRA_8888: return &bgra_ops;
+    default:                         return NULL;
+    }
+}
+
+/*****************************************************************************/
+/* by surface format, for callers drawing into arbitrary surfaces */
+
+int bl_supported(int format)
+{
+    return bl_get_ops(format) != NULL;
+}
+
+unsigned bl_pack_color(int format, unsigned char r, unsigned char g,
+                       unsigned char b, unsigned char a)
+{
+    return pack_color(format, r, g, b, a);
+}
+
+void bl_fill(GGLSurface *dst, int l, int t, int r, int b, unsigned pixel)
+{
+    bl_get_ops(dst->format)->fill(dst, l, t, r, b, pixel);
+}
+
+void bl_fill_blend(GGLSurface *dst, int l, int t, int r, int b,
+                   unsigned char cr, unsigned char cg, unsigned char cb, unsigned char ca)
+{
+    bl_get_ops(dst->format)->fill_blend(dst, l, t, r, b, cr, cg, cb, ca);
+}
+
+int bl_blit(GGLSurface *dst, int dx, int dy, const GGLSurface *src,
+            int sx, int sy, int w, int h)
+{
+    const struct bl_ops *ops = bl_get_ops(dst->format);
+    return ops ? ops->blit(dst, dx, dy, src, sx, sy, w, h) : 0;
+}
+
+void bl_glyph1(GGLSurface *dst, int x, int y, const unsigned char *bits, int pitch,
+               int w, int h, int l, int t, int r, int b, unsigned pixel)
+{
+    bl_get_ops(dst->format)->glyph1(dst, x, y, bits, pitch, w, h, l, t, r, b, pixel);
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _MINUI_BLITTER_H_
+#define _MINUI_BLITTER_H_
+
+#include <pixelflinger/pixelflinger.h>
+
+/*
+ * Fast paths for the few operations the UI really does: opaque and
+ * alpha-blended rect fills, and blits between 565 and 8888 surfaces. They
+ * write the same pixels pixelflinger would (within rounding). Rects are
+ * in surface coordinates and must already be clipped by the caller.
+ */
+
+/*
+ * The kernels specialized for one destination format. graphics.c picks
+ * the table of the framebuffer once at gr_init (and the one of each
+ * offscreen target), the bl_* functions below look it up on each call.
+ */
+struct bl_ops {
+    const char *name;
+    int format;
+    int bpp;
+    unsigned (*pack)(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+    void (*fill)(GGLSurface *dst, int l, int t, int r, int b, unsigned pixel);
+    void (*fill_blend)(GGLSurface *dst, int l, int t, int r, int b,
+                       unsigned char cr, unsigned char cg, unsigned char cb, unsigned char ca);
+    int (*blit)(GGLSurface *dst, int dx, int dy, const GGLSurface *src,
+                int sx, int sy, int w, int h);
+    void (*glyph1)(GGLSurface *dst, int x, int y, const unsigned char *bits, int pitch,
+                   int w, int h, int l, int t, int r, int b, unsigned pixel);
+};
+
+// NULL if there are no kernels for this format
+const struct bl_ops *bl_get_ops(int format);
+
+// returns 1 if the kernels can draw into surfaces of this format
+int bl_supported(int format);
+
+// color in the pixel layout of format (alpha is kept for 32bpp formats)
+unsigned bl_pack_color(int format, unsigned char r, unsigned char g,
+                       unsigned char b, unsigned char a);
+
+void bl_fill(GGLSurface *dst, int l, int t, int r, int b, unsigned pixel);
+void bl_fill_blend(GGLSurface *dst, int l, int t, int r, int b,
+                   unsigned char cr, unsigned char cg, unsigned char cb, unsigned char ca);
+
+// returns 0 if the pair of formats has no kernel (caller falls back)
+int bl_blit(GGLSurface *dst, int dx, int dy, const GGLSurface *src,
+            int sx, int sy, int w, int h);
+
+// 1bpp w x h bitmap, rows of pitch bytes with the leftmost pixel in the
+// msb, drawn at (x, y) with every set bit inside l, t, r, b set to pixel
+void bl_glyph1(GGLSurface *dst, int x, int y, const unsigned char *bits, int pitch,
+               int w, int h, int l, int t, int r, int b, unsigned pixel);
+
+#endif
@@ -16,9 +16,18 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include <fcntl.h>
 #include <dirent.h>
-#include <sys/poll.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/uio.h>
 #include <limits.h>
 
 #include <linux/input.h>
@@ -29,6 +38,28 @@
 
 #define MAX_DEVICES 16
 
+// events read at once per device, a touch packet is 5 to 8 of them
+#define EV_RING_SIZE 64
+
+/* Devices are only kept if they can send something the UI uses, or are
+ * in the allow list ($MINUI_INPUT_ALLOW), and not in the deny list
+ * ($MINUI_INPUT_DENY). Both are comma separated device names, "*"
+ * matching all. */
+#ifndef BOARD_BOOTMENU_INPUT_ALLOW
+#define BOARD_BOOTMENU_INPUT_ALLOW ""
+#endif
+#ifndef BOARD_BOOTMENU_INPUT_DENY
+#define BOARD_BOOTMENU_INPUT_DENY "bma250,accelerometer"
+#endif
+
+// what a device can send, from EVIOCGBIT
+#define EV_CLASS_KEYS      0x01
+#define EV_CLASS_TOUCH     0x02
+#define EV_CLASS_TRACKBALL 0x04
+#define EV_CLASS_SENSOR    0x08
+
+#define EV_BITS_LONGS(n) ((n) / (8 * sizeof(long)) + 1)
+
 #define VIBRATOR_TIMEOUT_FILE	"/sys/class/timed_output/vibrator/enable"
 
 #define ABS_MT_POSITION		0x2a	/* Group a set of X and Y */
@@ -39,6 +70,10 @@
 #define ABS_MT_WIDTH_MAJOR 0x32
 #define SYN_MT_REPORT 2
 
+#ifndef EVIOCSCLOCKID
+#define EVIOCSCLOCKID _IOW('E', 0xa0, int)
+#endif
+
 enum {
     DOWN_NOT,
     DOWN_SENT,
@@ -58,7 +93,10 @@ struct position {
 };
 
 struct ev {
-    struct pollfd *fd;
+    int fd;             // -1 for a free slot, unless replayed
+    int replayed;       // from $MINUI_INPUT_REPLAY, no fd
+    int mono;           // the kernel stamps events with CLOCK_MONOTONIC
+    char node[16];      // eventN in /dev/input
 
     struct virtualkey *vks;
     int vk_count;
@@ -69,11 +107,73 @@ struct ev {
 
     struct position p, mt_p;
     int down;
+
+    // read but not handled yet, ring[head] first
+    struct input_event ring[EV_RING_SIZE];
+    unsigned head, count;
 };
 
-static struct pollfd ev_fds[MAX_DEVICES];
+/* Devices are opened once, and stay open while the input is suspended.
+ * epoll reports which ones have events, inotify on /dev/input adds and
+ * removes them as they come and go. */
 static struct ev evs[MAX_DEVICES];
-static unsigned ev_count = 0;
+static int ev_epfd = -1;
+static int ev_inotify_fd = -1;
+/* written by ev_suspend() to return from a blocked ev_get(), and left
+ * readable until ev_resume(), so every thread waiting in it returns */
+static int ev_wake_fds[2] = { -1, -1 };
+static volatile int ev_suspended = 0;
+// epoll data of the inotify and wake fds, devices use their struct ev
+static char ev_inotify_tag, ev_wake_tag;
+
+static struct ev_stats ev_stats;
+static pid_t ev_tid = 0;    // thread calling ev_get()
+
+/* A recording ($MINUI_INPUT_RECORD) is a header then records: the
+ * devices as they are opened and closed, and every batch of events read,
+ * with the kernel timestamps, in the native struct layout.
+ * $MINUI_INPUT_REPLAY plays one back in place of /dev/input, from a file
+ * or a pipe, at the recorded pace times $MINUI_INPUT_REPLAY_SPEED, or as
+ * fast as ev_get() is called when that is 0. */
+#define EV_REC_MAGIC 0x52494d42 /* "BMIR" */
+#define EV_REC_VERSION 1
+
+struct ev_rec_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t event_size;    // sizeof(struct input_event) of the recorder
+};
+
+enum {
+    EV_REC_DEVICE = 1,      // struct ev_rec_device, count virtual keys
+    EV_REC_REMOVE,
+    EV_REC_EVENTS,          // count struct input_event
+};
+
+struct ev_rec {
+    uint16_t type;
+    uint16_t dev;           // slot in evs
+    uint32_t count;
+};
+
+struct ev_rec_device {
+    char name[64];
+    char node[16];
+    struct input_absinfo abs[4];    // p.xi, p.yi, mt_p.xi, mt_p.yi
+};
+
+static int ev_rec_fd = -1;
+
+static int ev_replay_fd = -1;
+static double ev_replay_speed = 1;
+// batch read ahead, handed out when due
+static struct ev_rec ev_replay_rec;
+static struct input_event ev_replay_buf[EV_RING_SIZE];
+static unsigned ev_replay_pending;
+// replay clock, started at the first batch
+static struct timespec ev_replay_start;
+static struct timeval ev_replay_first;
+static int ev_replay_started;
 
 static inline int ABS(int x) {
     return x<0?-x:x;
@@ -128,7 +228,7 @@ static int vk_init(struct ev *e)
     e->vk_count = 0;
 
     len = strlen(vk_path);
-    len = ioctl(e->fd->fd, EVIOCGNAME(sizeof(e->deviceName)), e->deviceName);
+    len = ioctl(e->fd, EVIOCGNAME(sizeof(e->deviceName)), e->deviceName);
     if (len <= 0)
     {
         LOGE("Unable to query event object.\n");
@@ -138,16 +238,6 @@ static int vk_init(struct ev *e)
     LOGI("Event object: %s\n", e->deviceName);
 #endif
 
-    // Blacklist these "input" devices
-    if (strcmp(e->deviceName, "bma250") == 0)
-    {
-        e->ignored = 1;
-    }
-    if (strcmp(e->deviceName, "accelerometer") == 0)
-    {
-        e->ignored = 1;
-    }
-
     strcat(vk_path, e->deviceName);
 
     // Some devices split the keys from the touchscreen
@@ -180,15 +270,15 @@ static int vk_init(struct ev *e)
         e->down = DOWN_NOT;
     }
 
-    ioctl(e->fd->fd, EVIOCGABS(ABS_X), &e->p.xi);
-    ioctl(e->fd->fd, EVIOCGABS(ABS_Y), &e->p.yi);
+    ioctl(e->fd, EVIOCGABS(ABS_X), &e->p.xi);
+    ioctl(e->fd, EVIOCGABS(ABS_Y), &e->p.yi);
     e->p.synced = 0;
 #ifdef _EVENT_LOGGING
     LOGI("EV: ST minX: %d  maxX: %d  minY: %d  maxY: %d\n", e->p.xi.minimum, e->p.xi.maximum, e->p.yi.minimum, e->p.yi.maximum);
 #endif
 
-    ioctl(e->fd->fd, EVIOCGABS(ABS_MT_POSITION_X), &e->mt_p.xi);
-    ioctl(e->fd->fd, EVIOCGABS(ABS_MT_POSITION_Y), &e->mt_p.yi);
+    ioctl(e->fd, EVIOCGABS(ABS_MT_POSITION_X), &e->mt_p.xi);
+    ioctl(e->fd, EVIOCGABS(ABS_MT_POSITION_Y), &e->mt_p.yi);
     e->mt_p.synced = 0;
 #ifdef _EVENT_LOGGING
     LOGI("EV: MT minX: %d  maxX: %d  minY: %d  maxY: %d\n", e->mt_p.xi.minimum, e->mt_p.xi.maximum, e->mt_p.yi.minimum, e->mt_p.yi.maximum);
@@ -220,54 +310,422 @@ static int vk_init(struct ev *e)
     return 0;
 }
 
+static inline int ev_test_bit(const unsigned long *bits, unsigned bit)
+{
+    return (bits[bit / (8 * sizeof(long))] >> (bit % (8 * sizeof(long)))) & 1;
+}
+
+static int ev_classify(int fd)
+{
+    unsigned long types[EV_BITS_LONGS(EV_MAX)];
+    unsigned long keys[EV_BITS_LONGS(KEY_MAX)];
+    unsigned long abs[EV_BITS_LONGS(ABS_MAX)];
+    unsigned long rel[EV_BITS_LONGS(REL_MAX)];
+    int cls = 0;
+    unsigned i;
+
+    memset(types, 0, sizeof(types));
+    memset(keys, 0, sizeof(keys));
+    memset(abs, 0, sizeof(abs));
+    memset(rel, 0, sizeof(rel));
+    if (ioctl(fd, EVIOCGBIT(0, sizeof(types)), types) < 0)
+        return -1;
+    if (ev_test_bit(types, EV_KEY))
+        ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys);
+    if (ev_test_bit(types, EV_ABS))
+        ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs)), abs);
+    if (ev_test_bit(types, EV_REL))
+        ioctl(fd, EVIOCGBIT(EV_REL, sizeof(rel)), rel);
+
+    // keyboard keys, not the BTN_* range of pointers and joysticks
+    for (i = 1; i <= KEY_MAX; i++) {
+        if ((i < BTN_MISC || i >= KEY_OK) && ev_test_bit(keys, i)) {
+            cls |= EV_CLASS_KEYS;
+            break;
+        }
+    }
+    // accelerometers report ABS_X/Y too, but no touch button
+    if (ev_test_bit(abs, ABS_MT_POSITION_X) || ev_test_bit(abs, ABS_MT_POSITION) ||
+        (ev_test_bit(abs, ABS_X) && ev_test_bit(keys, BTN_TOUCH)))
+        cls |= EV_CLASS_TOUCH;
+    if (ev_test_bit(rel, REL_Y) && !ev_test_bit(rel, REL_Z))
+        cls |= EV_CLASS_TRACKBALL;
+    if (ev_test_bit(rel, REL_Z) || (ev_test_bit(abs, ABS_Z) && !(cls & EV_CLASS_TOUCH)))
+        cls |= EV_CLASS_SENSOR;
+    return cls;
+}
+
+static int ev_listed(const char *list, const char *name)
+{
+    size_t len = strlen(name);
+
+    while (list && *list) {
+        const char *end = strchr(list, ',');
+        size_t n = end ? (size_t) (end - list) : strlen(list);
+        if ((n == 1 && *list == '*') || (n == len && !strncmp(list, name, n)))
+            return 1;
+        list = end ? end + 1 : NULL;
+    }
+    return 0;
+}
+
+/* whether the UI reads this device, logged either way */
+static int ev_wanted(int fd, const char *node)
+{
+    const char *allow = getenv("MINUI_INPUT_ALLOW");
+    const char *deny = getenv("MINUI_INPUT_DENY");
+    char name[64] = "";
+    const char *why;
+    int cls, use;
+
+    if (allow == NULL) allow = BOARD_BOOTMENU_INPUT_ALLOW;
+    if (deny == NULL) deny = BOARD_BOOTMENU_INPUT_DENY;
+
+    ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name);
+    cls = ev_classify(fd);
+
+    if (ev_listed(allow, name)) {
+        use = 1;
+        why = "allowed";
+    } else if (ev_listed(deny, name)) {
+        use = 0;
+        why = "denied";
+    } else if (cls < 0) {
+        use = 1;
+        why = "no EVIOCGBIT";
+    } else {
+        use = (cls & (EV_CLASS_KEYS | EV_CLASS_TOUCH | EV_CLASS_TRACKBALL)) &&
+              !(cls & EV_CLASS_SENSOR);
+        why = use ? "ui input" : (cls & EV_CLASS_SENSOR) ? "sensor" : "no ui input";
+    }
+
+    LOGI("input: %s \"%s\"%s%s%s: %s (%s)\n", node, name,
+         cls > 0 && (cls & EV_CLASS_KEYS) ? " keys" : "",
+         cls > 0 && (cls & EV_CLASS_TOUCH) ? " touch" : "",
+         cls > 0 && (cls & EV_CLASS_TRACKBALL) ? " trackball" : "",
+         use ? "used" : "closed", why);
+    return use;
+}
+
+// microseconds between two timevals
+static long long ev_tv_us(const struct timeval *a, const struct timeval *b)
+{
+    return (b->tv_sec - a->tv_sec) * 1000000LL + (b->tv_usec - a->tv_usec);
+}
+
+// events are stamped with CLOCK_MONOTONIC, like the ui's frames
+static void ev_stamp(struct timeval *tv)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    tv->tv_sec = ts.tv_sec;
+    tv->tv_usec = ts.tv_nsec / 1000;
+}
+
+/* Kernels before 3.4 have no EVIOCSCLOCKID and stamp with the wall clock,
+ * moved to CLOCK_MONOTONIC here. */
+static void ev_to_monotonic(struct input_event *ev, unsigned n)
+{
+    struct timeval rt, mono;
+    long long us, offset;
+    unsigned i;
+
+    gettimeofday(&rt, NULL);
+    ev_stamp(&mono);
+    offset = ev_tv_us(&mono, &rt);
+    for (i = 0; i < n; i++) {
+        us = ev[i].time.tv_sec * 1000000LL + ev[i].time.tv_usec - offset;
+        ev[i].time.tv_sec = us / 1000000;
+        ev[i].time.tv_usec = us % 1000000;
+    }
+}
+
+static inline int ev_used(const struct ev *e)
+{
+    return e->fd >= 0 || e->replayed;
+}
+
+static void ev_cloexec(int fd)
+{
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+static void ev_rec_write(const struct ev_rec *rec, const void *data, size_t len)
+{
+    struct iovec iov[2];
+    ssize_t want = sizeof(*rec) + len;
+
+    iov[0].iov_base = (void *) rec;
+    iov[0].iov_len = sizeof(*rec);
+    iov[1].iov_base = (void *) data;
+    iov[1].iov_len = len;
+    if (writev(ev_rec_fd, iov, len ? 2 : 1) != want) {
+        LOGW("input: recording stopped (%s)\n", strerror(errno));
+        close(ev_rec_fd);
+        ev_rec_fd = -1;
+    }
+}
+
+static void ev_rec_device(struct ev *e)
+{
+    struct ev_rec rec;
+    struct {
+        struct ev_rec_device d;
+        struct virtualkey vks[32];
+    } dev;
+    int n = e->vk_count > 32 ? 32 : e->vk_count;
+
+    if (ev_rec_fd < 0)
+        return;
+    memset(&dev, 0, sizeof(dev));
+    memcpy(dev.d.name, e->deviceName, sizeof(dev.d.name));
+    memcpy(dev.d.node, e->node, sizeof(dev.d.node));
+    dev.d.abs[0] = e->p.xi;
+    dev.d.abs[1] = e->p.yi;
+    dev.d.abs[2] = e->mt_p.xi;
+    dev.d.abs[3] = e->mt_p.yi;
+    if (n > 0)
+        memcpy(dev.vks, e->vks, n * sizeof(*e->vks));
+
+    rec.type = EV_REC_DEVICE;
+    rec.dev = e - evs;
+    rec.count = n > 0 ? n : 0;
+    ev_rec_write(&rec, &dev, sizeof(dev.d) + rec.count * sizeof(*e->vks));
+}
+
+static void ev_close(struct ev *e)
+{
+    if (ev_rec_fd >= 0) {
+        struct ev_rec rec = { EV_REC_REMOVE, e - evs, 0 };
+        ev_rec_write(&rec, NULL, 0);
+    }
+    if (e->fd >= 0) {
+        epoll_ctl(ev_epfd, EPOLL_CTL_DEL, e->fd, NULL);
+        close(e->fd);
+    }
+    if (e->vk_count) {
+        free(e->vks);
+        e->vks = NULL;
+        e->vk_count = 0;
+    }
+    e->fd = -1;
+    e->replayed = 0;
+}
+
+static void ev_open(int dirfd, const char *node)
+{
+    struct epoll_event eev;
+    struct ev *e = NULL;
+    unsigned i;
+    int fd, clk;
+
+    if (strncmp(node, "event", 5))
+        return;
+    for (i = 0; i < MAX_DEVICES; i++) {
+        if (ev_used(&evs[i]) && !strcmp(evs[i].node, node))
+            return;
+        if (e == NULL && !ev_used(&evs[i]))
+            e = &evs[i];
+    }
+    if (e == NULL)
+        return;
+
+    // non blocking, to drain what came while suspended
+    fd = openat(dirfd, node, O_RDONLY | O_NONBLOCK);
+    if (fd < 0)
+        return;
+    ev_cloexec(fd);
+    // sensors would wake the input thread for nothing
+    if (!ev_wanted(fd, node)) {
+        close(fd);
+        return;
+    }
+
+    memset(e, 0, sizeof(*e));
+    e->fd = fd;
+    strncpy(e->node, node, sizeof(e->node) - 1);
+    clk = CLOCK_MONOTONIC;
+    e->mono = ioctl(fd, EVIOCSCLOCKID, &clk) == 0;
+
+    /* Load virtualkeys if there are any */
+    vk_init(e);
+    ev_rec_device(e);
+
+    memset(&eev, 0, sizeof(eev));
+    eev.events = EPOLLIN;
+    eev.data.ptr = e;
+    if (epoll_ctl(ev_epfd, EPOLL_CTL_ADD, fd, &eev) < 0)
+        ev_close(e);
+}
+
+static void ev_add_fd(int fd, void *tag)
+{
+    struct epoll_event eev;
+
+    memset(&eev, 0, sizeof(eev));
+    eev.events = EPOLLIN;
+    eev.data.ptr = tag;
+    epoll_ctl(ev_epfd, EPOLL_CTL_ADD, fd, &eev);
+}
+
+// nodes created or removed in /dev/input
+static void ev_hotplug(void)
+{
+    char buf[512];
+    ssize_t len, i;
+    int dirfd;
+
+    while ((len = read(ev_inotify_fd, buf, sizeof(buf))) > 0) {
+        for (i = 0; i < len; ) {
+            struct inotify_event *ie = (struct inotify_event *) (buf + i);
+            unsigned n;
+
+            i += sizeof(*ie) + ie->len;
+            if (ie->len == 0)
+                continue;
+            if (ie->mask & IN_CREATE) {
+                dirfd = open("/dev/input", O_RDONLY);
+                if (dirfd < 0)
+                    continue;
+                LOGI("input: %s added\n", ie->name);
+                ev_open(dirfd, ie->name);
+                close(dirfd);
+            } else if (ie->mask & IN_DELETE) {
+                for (n = 0; n < MAX_DEVICES; n++) {
+                    if (ev_used(&evs[n]) && !strcmp(evs[n].node, ie->name)) {
+                        LOGI("input: %s removed\n", ie->name);
+                        ev_close(&evs[n]);
+                    }
+                }
+            }
+        }
+    }
+}
+
 int ev_init(void)
 {
     DIR *dir;
     struct dirent *de;
-    int fd;
+    unsigned i;
 
-    dir = opendir("/dev/input");
-    if (dir != 0) {
-        while ((de = readdir(dir))) {
+    // already open, only suspended by ev_suspend()
+    if (ev_epfd >= 0) {
+        ev_resume();
+        return 0;
+    }
 
-            if (strncmp(de->d_name,"event",5)) continue;
-            fd = openat(dirfd(dir), de->d_name, O_RDONLY);
-            if (fd < 0) continue;
+    ev_epfd = epoll_create(MAX_DEVICES + 2);
+    if (ev_epfd < 0)
+        return -1;
+    ev_cloexec(ev_epfd);
+    for (i = 0; i < MAX_DEVICES; i++) {
+        evs[i].fd = -1;
+        evs[i].replayed = 0;
+    }
 
-            ev_fds[ev_count].fd = fd;
-            ev_fds[ev_count].events = POLLIN;
-            evs[ev_count].fd = &ev_fds[ev_count];
+    if (pipe(ev_wake_fds) == 0) {
+        for (i = 0; i < 2; i++) {
+            ev_cloexec(ev_wake_fds[i]);
+            fcntl(ev_wake_fds[i], F_SETFL, O_NONBLOCK);
+        }
+        ev_add_fd(ev_wake_fds[0], &ev_wake_tag);
+    }
 
-            /* Load virtualkeys if there are any */
-            vk_init(&evs[ev_count]);
+    if (getenv("MINUI_INPUT_RECORD"))
+        ev_record(getenv("MINUI_INPUT_RECORD"));
+    if (ev_replay_fd < 0 && getenv("MINUI_INPUT_REPLAY")) {
+        const char *speed = getenv("MINUI_INPUT_REPLAY_SPEED");
+        ev_replay(getenv("MINUI_INPUT_REPLAY"), speed ? atof(speed) : 1);
+    }
+    // the recording stands in for /dev/input
+    if (ev_replay_fd >= 0) {
+        ev_suspended = 0;
+        return 0;
+    }
 
-            ev_count++;
-            if (ev_count == MAX_DEVICES) break;
+    // watched before the scan, so no node is missed in between
+    ev_inotify_fd = inotify_init();
+    if (ev_inotify_fd >= 0) {
+        ev_cloexec(ev_inotify_fd);
+        fcntl(ev_inotify_fd, F_SETFL, O_NONBLOCK);
+        if (inotify_add_watch(ev_inotify_fd, "/dev/input", IN_CREATE | IN_DELETE) < 0) {
+            close(ev_inotify_fd);
+            ev_inotify_fd = -1;
+        } else {
+            ev_add_fd(ev_inotify_fd, &ev_inotify_tag);
         }
+    }
 
-        if (ev_count >= MAX_DEVICES) {
-            ev_count = MAX_DEVICES-1;
-        }
+    dir = opendir("/dev/input");
+    if (dir != 0) {
+        while ((de = readdir(dir)))
+            ev_open(dirfd(dir), de->d_name);
+        closedir(dir);
     }
 
+    ev_suspended = 0;
     return 0;
 }
 
-void ev_exit(void)
+void ev_suspend(void)
 {
-    if (ev_count >= MAX_DEVICES) {
-        ev_count = MAX_DEVICES-1;
-    }
+    char c = 0;
+
+    if (ev_epfd < 0 || ev_suspended)
+        return;
+    ev_suspended = 1;
+    __sync_synchronize();
+    if (ev_wake_fds[1] >= 0)
+        write(ev_wake_fds[1], &c, 1);
+}
 
-    while (ev_count > 0) {
-        ev_count--;
-        if (evs[ev_count].vk_count) {
-            free(evs[ev_count].vks);
-            evs[ev_count].vks = NULL;
-            evs[ev_count].vk_count = 0;
+void ev_resume(void)
+{
+    struct input_event buf[EV_RING_SIZE];
+    unsigned i;
+    char c;
+
+    if (ev_epfd < 0 || !ev_suspended)
+        return;
+    while (read(ev_wake_fds[0], &c, 1) > 0)
+        ;
+    // what came while suspended isn't meant for the UI
+    for (i = 0; i < MAX_DEVICES; i++) {
+        if (evs[i].fd >= 0) {
+            while (read(evs[i].fd, buf, sizeof(buf)) > 0)
+                ;
         }
-        close(ev_fds[ev_count].fd);
+        evs[i].head = evs[i].count = 0;
+    }
+    // the thread ev_suspend() woke is gone, the next ev_get() is another
+    ev_tid = 0;
+    ev_suspended = 0;
+}
+
+void ev_exit(void)
+{
+    unsigned i;
+
+    if (ev_epfd < 0)
+        return;
+    for (i = 0; i < MAX_DEVICES; i++) {
+        if (ev_used(&evs[i]))
+            ev_close(&evs[i]);
+    }
+    ev_record(NULL);
+    ev_replay(NULL, 0);
+    if (ev_inotify_fd >= 0)
+        close(ev_inotify_fd);
+    for (i = 0; i < 2; i++) {
+        if (ev_wake_fds[i] >= 0)
+            close(ev_wake_fds[i]);
+        ev_wake_fds[i] = -1;
     }
+    close(ev_epfd);
+    ev_inotify_fd = ev_epfd = -1;
+    ev_suspended = 0;
+    ev_tid = 0;
 }
 
 static int vk_inside_display(__s32 value, struct input_absinfo *info, int screen_size)
@@ -530,26 +988,341 @@ static int vk_modify(struct ev *e, struct input_event *ev)
     return 0;
 }
 
-int ev_get(struct input_event *ev, unsigned dont_wait)
+static void ev_account(const struct input_event *ev, unsigned n)
+{
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        if (ev[i].type == EV_SYN && ev[i].code == SYN_REPORT)
+            ev_stats.packets++;
+    }
+    ev_stats.events += n;
+}
+
+/* Reads what fits in the ring of the device, whole events only: the
+ * kernel returns as many as are queued, usually several packets. */
+static void ev_fill(struct ev *e)
+{
+    unsigned tail = (e->head + e->count) % EV_RING_SIZE;
+    unsigned room = EV_RING_SIZE - e->count;
+    ssize_t r;
+    unsigned n;
+
+    // contiguous free space only, the rest is read next time
+    if (room > EV_RING_SIZE - tail)
+        room = EV_RING_SIZE - tail;
+    if (room == 0)
+        return;
+
+    r = read(e->fd, &e->ring[tail], room * sizeof(struct input_event));
+    ev_stats.reads++;
+    if (r < 0 && errno == ENODEV) {
+        // unplugged, before inotify tells
+        ev_close(e);
+        return;
+    }
+    if (r < (ssize_t) sizeof(struct input_event))
+        return;
+
+    n = r / sizeof(struct input_event);
+    if (!e->mono)
+        ev_to_monotonic(&e->ring[tail], n);
+    if (ev_rec_fd >= 0) {
+        struct ev_rec rec = { EV_REC_EVENTS, e - evs, n };
+        ev_rec_write(&rec, &e->ring[tail], n * sizeof(struct input_event));
+    }
+    ev_account(&e->ring[tail], n);
+    e->count += n;
+}
+
+int ev_record(const char *path)
+{
+    struct ev_rec_header hdr = { EV_REC_MAGIC, EV_REC_VERSION, sizeof(struct input_event) };
+    unsigned i;
+
+    if (ev_rec_fd >= 0) {
+        close(ev_rec_fd);
+        ev_rec_fd = -1;
+    }
+    if (path == NULL || *path == '\0')
+        return 0;
+
+    ev_rec_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (ev_rec_fd < 0) {
+        LOGW("input: can't record to %s (%s)\n", path, strerror(errno));
+        return -1;
+    }
+    ev_cloexec(ev_rec_fd);
+    if (write(ev_rec_fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+        close(ev_rec_fd);
+        ev_rec_fd = -1;
+        return -1;
+    }
+    // the devices already open
+    for (i = 0; i < MAX_DEVICES; i++) {
+        if (ev_used(&evs[i]))
+            ev_rec_device(&evs[i]);
+    }
+    LOGI("input: recording to %s\n", path);
+    return 0;
+}
+
+// whole reads, from a pipe too
+static int ev_replay_read(void *buf, size_t len)
+{
+    char *p = buf;
+    ssize_t r;
+
+    while (len) {
+        r = read(ev_replay_fd, p, len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        p += r;
+        len -= r;
+    }
+    return 0;
+}
+
+int ev_replay(const char *path, double speed)
+{
+    struct ev_rec_header hdr;
+
+    if (ev_replay_fd >= 0) {
+        close(ev_replay_fd);
+        ev_replay_fd = -1;
+    }
+    ev_replay_pending = 0;
+    ev_replay_started = 0;
+    if (path == NULL || *path == '\0')
+        return 0;
+
+    ev_replay_fd = open(path, O_RDONLY);
+    if (ev_replay_fd < 0) {
+        LOGW("input: can't replay %s (%s)\n", path, strerror(errno));
+        return -1;
+    }
+    ev_cloexec(ev_replay_fd);
+    if (ev_replay_read(&hdr, sizeof(hdr)) < 0 || hdr.magic != EV_REC_MAGIC ||
+        hdr.version != EV_REC_VERSION || hdr.event_size != sizeof(struct input_event)) {
+        LOGW("input: %s is not a recording of this build\n", path);
+        close(ev_replay_fd);
+        ev_replay_fd = -1;
+        return -1;
+    }
+    ev_replay_speed = speed > 0 ? speed : 0;
+    LOGI("input: replaying %s\n", path);
+    return 0;
+}
+
+static void ev_replay_device(const struct ev_rec *rec)
+{
+    struct ev_rec_device d;
+    struct ev *e = &evs[rec->dev];
+
+    if (ev_replay_read(&d, sizeof(d)) < 0)
+        return;
+    if (ev_used(e))
+        ev_close(e);
+    memset(e, 0, sizeof(*e));
+    e->fd = -1;
+    e->replayed = 1;
+    memcpy(e->deviceName, d.name, sizeof(e->deviceName) - 1);
+    memcpy(e->node, d.node, sizeof(e->node) - 1);
+    e->p.xi = d.abs[0];
+    e->p.yi = d.abs[1];
+    e->mt_p.xi = d.abs[2];
+    e->mt_p.yi = d.abs[3];
+    e->down = DOWN_NOT;
+    if (rec->count) {
+        e->vks = malloc(rec->count * sizeof(*e->vks));
+        if (e->vks == NULL || ev_replay_read(e->vks, rec->count * sizeof(*e->vks)) < 0) {
+            e->replayed = 0;
+            return;
+        }
+        e->vk_count = rec->count;
+    }
+    LOGI("input: %s \"%s\": replayed\n", e->node, e->deviceName);
+    ev_rec_device(e);
+}
+
+int ev_replaying(void)
+{
+    return ev_replay_fd >= 0;
+}
+
+/* Reads the recording up to the next batch of events, and copies it to the
+ * ring of its device when it is due. Returns the ms until the next batch
+ * is due, 0 if one was handed out, -1 when the recording is over. */
+static int ev_replay_step(void)
+{
+    struct ev_rec *rec = &ev_replay_rec;
+    struct ev *e;
+    unsigned i, tail;
+
+    while (ev_replay_pending == 0) {
+        if (ev_replay_read(rec, sizeof(*rec)) < 0 || rec->dev >= MAX_DEVICES) {
+            LOGI("input: replay done\n");
+            ev_replay(NULL, 0);
+            return -1;
+        }
+        if (rec->type == EV_REC_DEVICE) {
+            ev_replay_device(rec);
+        } else if (rec->type == EV_REC_REMOVE) {
+            if (evs[rec->dev].replayed)
+                ev_close(&evs[rec->dev]);
+        } else if (rec->type == EV_REC_EVENTS && rec->count <= EV_RING_SIZE &&
+                   ev_replay_read(ev_replay_buf, rec->count * sizeof(struct input_event)) == 0) {
+            ev_replay_pending = rec->count;
+        } else {
+            LOGW("input: bad record %u in the replay\n", rec->type);
+            ev_replay(NULL, 0);
+            return -1;
+        }
+    }
+
+    e = &evs[rec->dev];
+    if (!e->replayed) {
+        ev_replay_pending = 0;
+        return 0;
+    }
+
+    if (ev_replay_speed > 0) {
+        struct timespec now;
+        long long due, elapsed;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (!ev_replay_started) {
+            ev_replay_start = now;
+            ev_replay_first = ev_replay_buf[0].time;
+            ev_replay_started = 1;
+        }
+        due = ev_tv_us(&ev_replay_first, &ev_replay_buf[0].time) / ev_replay_speed;
+        elapsed = (now.tv_sec - ev_replay_start.tv_sec) * 1000000LL +
+                  (now.tv_nsec - ev_replay_start.tv_nsec) / 1000;
+        if (elapsed < due)
+            return (due - elapsed + 999) / 1000;
+    }
+
+    // waits for ev_drain() to make room
+    if (EV_RING_SIZE - e->count < ev_replay_pending)
+        return 0;
+
+    // stamped when handed out, as the kernel would
+    tail = (e->head + e->count) % EV_RING_SIZE;
+    for (i = 0; i < ev_replay_pending; i++) {
+        struct input_event *ev = &e->ring[(tail + i) % EV_RING_SIZE];
+        *ev = ev_replay_buf[i];
+        ev_stamp(&ev->time);
+    }
+    ev_account(ev_replay_buf, ev_replay_pending);
+    e->count += ev_replay_pending;
+    ev_replay_pending = 0;
+    return 0;
+}
+
+/* Hands out the events already read, in order, so a packet is handled
+ * without going back to epoll_wait(). Returns 0 with ev set if one is left. */
+static int ev_drain(struct input_event *ev)
 {
-    int r;
     unsigned n;
 
+    for (n = 0; n < MAX_DEVICES; n++) {
+        struct ev *e = &evs[n];
+        while (ev_used(e) && e->count) {
+            *ev = e->ring[e->head];
+            e->head = (e->head + 1) % EV_RING_SIZE;
+            e->count--;
+            if (!vk_modify(e, ev))
+                return 0;
+        }
+    }
+    return -1;
+}
+
+/* Returns -1 without waiting when suspended, or when ev_suspend() woke
+ * it up, so a thread reading input can check whether to stop. */
+int ev_get(struct input_event *ev, unsigned dont_wait)
+{
+    struct epoll_event events[MAX_DEVICES + 2];
+    int r, i, woken, timeout, due;
+
+    if (ev_tid == 0)
+        ev_tid = syscall(__NR_gettid);
+
     do {
-        r = poll(ev_fds, ev_count, dont_wait ? 0 : -1);
-
-        if(r > 0) {
-            for(n = 0; n < ev_count; n++) {
-                if(ev_fds[n].revents & POLLIN) {
-                    r = read(ev_fds[n].fd, ev, sizeof(*ev));
-                    if(r == sizeof(*ev)) {
-                        if (!vk_modify(&evs[n], ev))
-                            return 0;
-                    }
-                }
+        if (ev_epfd < 0 || ev_suspended)
+            return -1;
+        if (ev_drain(ev) == 0)
+            return 0;
+
+        timeout = dont_wait ? 0 : -1;
+        if (ev_replay_fd >= 0) {
+            // what is due goes to the rings without waiting
+            due = ev_replay_step();
+            if (ev_drain(ev) == 0)
+                return 0;
+            if (due >= 0 && (timeout < 0 || due < timeout))
+                timeout = due;
+        }
+
+        r = epoll_wait(ev_epfd, events, MAX_DEVICES + 2, timeout);
+        ev_stats.polls++;
+
+        woken = 0;
+        for (i = 0; i < r; i++) {
+            void *tag = events[i].data.ptr;
+            if (tag == &ev_wake_tag) {
+                // drained by ev_resume()
+                woken = 1;
+            } else if (tag == &ev_inotify_tag) {
+                ev_hotplug();
+            } else {
+                ev_fill((struct ev *) tag);
             }
         }
+        if (woken)
+            return -1;
+        if (ev_drain(ev) == 0)
+            return 0;
     } while(dont_wait == 0);
 
     return -1;
 }
+
+// cpu time of the thread from /proc, so ev_get() doesn't pay for it
+static unsigned ev_thread_cpu_ms(void)
+{
+    char path[64], buf[512], *p;
+    unsigned long utime, stime;
+    long hz = sysconf(_SC_CLK_TCK);
+    ssize_t len;
+    int fd;
+
+    if (ev_tid == 0 || hz <= 0)
+        return 0;
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", (int) ev_tid);
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0)
+        return 0;
+    buf[len] = '\0';
+
+    // fields 14 and 15, counted after the ")" ending the name
+    p = strrchr(buf, ')');
+    if (p == NULL ||
+        sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+               &utime, &stime) != 2)
+        return 0;
+    return (utime + stime) * 1000 / hz;
+}
+
+void ev_get_stats(struct ev_stats *st)
+{
+    *st = ev_stats;
+    st->cpu_ms = ev_thread_cpu_ms();
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/fb.h>
+#include <pixelflinger/pixelflinger.h>
+
+#include "fb_mem.h"
+
+#define MEMFB_PAGES 2
+
+static const struct {
+    const char *name;
+    int format;
+    int bpp;
+    int r, g, b, a; // bit offsets, -1 if none
+} MEMFB_FORMATS[] = {
+    { "rgb565", GGL_PIXEL_FORMAT_RGB_565,   16, 11, 5,  0, -1 },
+    { "rgbx",   GGL_PIXEL_FORMAT_RGBX_8888, 32,  0, 8, 16, -1 },
+    { "rgba",   GGL_PIXEL_FORMAT_RGBA_8888, 32,  0, 8, 16, 24 },
+    { "bgra",   GGL_PIXEL_FORMAT_BGRA_8888, 32, 16, 8,  0, 24 },
+    { NULL, 0, 0, 0, 0, 0, 0 },
+};
+
+static void memfb_set_field(struct fb_bitfield *f, int offset, int length)
+{
+    f->offset = (offset < 0) ? 0 : offset;
+    f->length = (offset < 0) ? 0 : length;
+    f->msb_right = 0;
+}
+
+void *memfb_open(const char *spec, int *format,
+                 struct fb_var_screeninfo *vi, struct fb_fix_screeninfo *fi)
+{
+    unsigned width = 480, height = 854;
+    char name[16] = "";
+    void *bits;
+    int i;
+
+    if (spec && strncmp(spec, "mem", 3) == 0 && spec[3] == ':') {
+        sscanf(spec + 4, "%ux%u:%15s", &width, &height, name);
+    }
+
+    for (i = 0; MEMFB_FORMATS[i].name; i++) {
+        if (name[0] ? !strcmp(name, MEMFB_FORMATS[i].name)
+                    : MEMFB_FORMATS[i].format == *format)
+            break;
+    }
+    if (MEMFB_FORMATS[i].name == NULL || width == 0 || height == 0) {
+        fprintf(stderr, "memfb: unsupported spec %s\n", spec);
+        return NULL;
+    }
+
+    memset(vi, 0, sizeof(*vi));
+    memset(fi, 0, sizeof(*fi));
+
+    vi->xres = vi->xres_virtual = width;
+    vi->yres = height;
+    vi->yres_virtual = height * MEMFB_PAGES;
+    vi->bits_per_pixel = MEMFB_FORMATS[i].bpp;
+    if (vi->bits_per_pixel == 16) {
+        memfb_set_field(&vi->red, 11, 5);
+        memfb_set_field(&vi->green, 5, 6);
+        memfb_set_field(&vi->blue, 0, 5);
+        memfb_set_field(&vi->transp, -1, 0);
+    } else {
+        memfb_set_field(&vi->red, MEMFB_FORMATS[i].r, 8);
+        memfb_set_field(&vi->green, MEMFB_FORMATS[i].g, 8);
+        memfb_set_field(&vi->blue, MEMFB_FORMATS[i].b, 8);
+        memfb_set_field(&vi->transp, MEMFB_FORMATS[i].a, 8);
+    }
+
+    strcpy(fi->id, "memfb");
+    fi->line_length = width * vi->bits_per_pixel / 8;
+    fi->smem_len = fi->line_length * height * MEMFB_PAGES;
+
+    bits = calloc(1, fi->smem_len);
+    if (bits == NULL) {
+        perror("memfb: cannot allocate pages");
+        return NULL;
+    }
+
+    *format = MEMFB_FORMATS[i].format;
+    fprintf(stderr, "memfb: %ux%u %s\n", width, height, MEMFB_FORMATS[i].name);
+    return bits;
+}
+
+void memfb_close(void *bits)
+{
+    free(bits);
+}
+
+int memfb_dump_ppm(const char *path, const GGLSurface *s)
+{
+    unsigned char *line;
+    unsigned x, y;
+    FILE *f;
+
+    f = fopen(path, "wb");
+    if (f == NULL)
+        return -1;
+
+    line = malloc(s->width * 3);
+    if (line == NULL) {
+        fclose(f);
+        return -1;
+    }
+
+    fprintf(f, "P6\n%u %u\n255\n", s->width, s->height);
+    for (y = 0; y < s->height; y++) {
+        for (x = 0; x < s->width; x++) {
+            unsigned char *rgb = line + x * 3;
+            if (s->format == GGL_PIXEL_FORMAT_RGB_565) {
+                unsigned p = ((unsigned short*) s->data)[y * s->stride + x];
+                rgb[0] = ((p >> 11) & 0x1f) * 255 / 31;
+                rgb[1] = ((p >> 5) & 0x3f) * 255 / 63;
+                rgb[2] = (p & 0x1f) * 255 / 31;
+            } else {
+                unsigned char *p = s->data + (y * s->stride + x) * 4;
+                int bgr = (s->format == GGL_PIXEL_FORMAT_BGRA_8888);
+                rgb[0] = p[bgr ? 2 : 0];
+                rgb[1] = p[1];
+                rgb[2] = p[bgr ? 0 : 2];
+            }
+        }
+        fwrite(line, 3, s->width, f);
+    }
+
+    free(line);
+    return fclose(f);
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _MINUI_FB_MEM_H_
+#define _MINUI_FB_MEM_H_
+
+#include <linux/fb.h>
+#include <pixelflinger/pixelflinger.h>
+
+/*
+ * Memory backed framebuffer, used instead of /dev/graphics/fb0 to run
+ * minui without a display (benchmarks, host builds).
+ *
+ * spec is "mem[:WIDTHxHEIGHT[:FORMAT]]", FORMAT one of rgb565, rgbx,
+ * rgba or bgra. *format holds the default format and gets the chosen one.
+ * Returns two pages of pixels described by vi and fi, or NULL.
+ */
+void *memfb_open(const char *spec, int *format,
+                 struct fb_var_screeninfo *vi, struct fb_fix_screeninfo *fi);
+void memfb_close(void *bits);
+
+// writes a surface as a binary (P6) PPM, returns 0 on success
+int memfb_dump_ppm(const char *path, const GGLSurface *s);
+
+#endif
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pixelflinger/pixelflinger.h>
+
+#include "minui.h"
+#include "blitter.h"
+#include "glyph_cache.h"
+
+#define GC_BUCKETS   64
+/* a 15x24 glyph is ~1.5k in 32bpp, that's room for the whole UI text */
+#define GC_MAX_BYTES (256 * 1024)
+
+/* a run of covered pixels on one glyph row, [x0, x1) */
+struct gc_span {
+    unsigned char y, x0, x1;
+};
+
+struct gc_glyph {
+    struct gc_glyph *next;
+
+    // key
+    GRFont *font;
+    unsigned ch;
+    unsigned color;
+    int format;
+
+    int w, h, bpp;
+    int nspans;
+    struct gc_span *spans;
+    unsigned char *pixels;
+};
+
+static struct gc_glyph *gc_table[GC_BUCKETS];
+static unsigned gc_hits = 0, gc_misses = 0;
+static unsigned gc_entries = 0, gc_bytes = 0;
+
+static inline unsigned gc_hash(GRFont *font, unsigned ch, unsigned color)
+{
+    return (((uintptr_t) font >> 4) + ch * 31 + color * 7) % GC_BUCKETS;
+}
+
+void gc_flush(void)
+{
+    struct gc_glyph *g, *next;
+    int i;
+
+    for (i = 0; i < GC_BUCKETS; i++) {
+        for (g = gc_table[i]; g; g = next) {
+            next = g->next;
+            arena_free(&gr_arena, g);
+        }
+        gc_table[i] = NULL;
+    }
+    gc_entries = gc_bytes = 0;
+}
+
+void gc_stats(struct gr_glyph_stats *st)
+{
+    st->hits = gc_hits;
+    st->misses = gc_misses;
+    st->entries = gc_entries;
+    st->bytes = gc_bytes;
+}
+
+static inline int gc_bit(const unsigned char *row, int x)
+{
+    return row[x / 8] & (0x80 >> (x & 7));
+}
+
+/* expand one 1bpp glyph of the font, coverage is kept as spans */
+static struct gc_glyph *gc_create(GRFont *font, unsigned ch, unsigned color, int format)
+{
+    const unsigned char *bits = font->glyphs + ch * font->cheight * font->pitch;
+    struct gc_glyph *g;
+    int w = font->cwidth, h = font->cheight;
+    int bpp = (format == GGL_PIXEL_FORMAT_RGB_565) ? 2 : 4;
+    int x, y, nspans = 0;
+    unsigned size;
+
+    for (y = 0; y < h; y++) {
+        const unsigned char *row = bits + y * font->pitch;
+        for (x = 0; x < w; x++) {
+            if (gc_bit(row, x) && (x == 0 || !gc_bit(row, x - 1)))
+                nspans++;
+        }
+    }
+
+    size = sizeof(*g) + nspans * sizeof(struct gc_span) + w * h * bpp;
+    if (gc_bytes + size > GC_MAX_BYTES)
+        gc_flush();
+
+    g = arena_alloc(&gr_arena, size);
+    if (g == NULL)
+        return NULL;
+
+    g->font = font;
+    g->ch = ch;
+    g->color = color;
+    g->format = format;
+    g->w = w;
+    g->h = h;
+    g->bpp = bpp;
+    g->nspans = 0;
+    g->spans = (struct gc_span*) (g + 1);
+    g->pixels = (unsigned char*) (g->spans + nspans);
+
+    if (bpp == 2) {
+        uint16_t *p = (uint16_t*) g->pixels;
+        for (x = 0; x < w * h; x++) p[x] = color;
+    } else {
+        uint32_t *p = (uint32_t*) g->pixels;
+        for (x = 0; x < w * h; x++) p[x] = color;
+    }
+
+    for (y = 0; y < h; y++) {
+        const unsigned char *row = bits + y * font->pitch;
+        for (x = 0; x < w; x++) {
+            if (!gc_bit(row, x))
+                continue;
+            struct gc_span *sp = &g->spans[g->nspans++];
+            sp->y = y;
+            sp->x0 = x;
+            while (x < w && gc_bit(row, x)) x++;
+            sp->x1 = x;
+        }
+    }
+
+    unsigned i = gc_hash(font, ch, color);
+    g->next = gc_table[i];
+    gc_table[i] = g;
+    gc_entries++;
+    gc_bytes += size;
+    return g;
+}
+
+/* with !create the cache is only read (and not counted), so several
+ * threads can draw from it as long as nobody adds glyphs meanwhile */
+static struct gc_glyph *gc_lookup(GRFont *font, unsigned ch, unsigned color, int format,
+                                  int create)
+{
+    struct gc_glyph *g;
+
+    for (g = gc_table[gc_hash(font, ch, color)]; g; g = g->next) {
+        if (g->font == font && g->ch == ch && g->color == color && g->format == format) {
+            if (create)
+                gc_hits++;
+            return g;
+        }
+    }
+    if (!create)
+        return NULL;
+    gc_misses++;
+    return gc_create(font, ch, color, format);
+}
+
+static void gc_blit(GGLSurface *dst, struct gc_glyph *g, int x, int y,
+                    int l, int t, int r, int b, int clip)
+{
+    int bpp = g->bpp, i;
+    unsigned char *base = dst->data;
+
+    for (i = 0; i < g->nspans; i++) {
+        const struct gc_span *sp = &g->spans[i];
+        int yy = y + sp->y, x0 = x + sp->x0, x1 = x + sp->x1;
+
+        if (clip) {
+            if (yy < t || yy >= b) continue;
+            if (x0 < l) x0 = l;
+            if (x1 > r) x1 = r;
+            if (x0 >= x1) continue;
+        }
+        memcpy(base + (yy * dst->stride + x0) * bpp,
+               g->pixels + (sp->y * g->w + x0 - x) * bpp, (x1 - x0) * bpp);
+    }
+}
+
+void gc_draw_text(GGLSurface *dst, GRFont *font, int x, int y, const char *s,
+                  int l, int t, int r, int b, unsigned char cr, unsigned char cg,
+                  unsigned char cb, int create)
+{
+    unsigned color = bl_pack_color(dst->format, cr, cg, cb, 255);
+    int cw = font->cwidth, ch = font->cheight;
+    int right = x + cw * strlen(s);
+    unsigned off;
+    int clip;
+
+    // whole string accept/reject
+    if (right <= l || x >= r || y + ch <= t || y >= b)
+        return;
+    clip = (x < l || right > r || y < t || y + ch > b);
+
+    for (; (off = (unsigned char) *s); s++, x += cw) {
+        off -= 32;
+        if (off >= 96)
+            continue;
+        if (clip && (x + cw <= l || x >= r))
+            continue;
+
+        struct gc_glyph *g = gc_lookup(font, off, color, dst->format, create);
+        if (g != NULL)
+            gc_blit(dst, g, x, y, l, t, r, b, clip);
+        else
+            bl_glyph1(dst, x, y, font->glyphs + off * font->cheight * font->pitch,
+                      font->pitch, cw, ch, l, t, r, b, color);
+    }
+}
+
+void gc_prepare_text(GRFont *font, int format, const char *s,
+                     unsigned char cr, unsigned char cg, unsigned char cb)
+{
+    unsigned color = bl_pack_color(format, cr, cg, cb, 255);
+    unsigned off;
+
+    for (; (off = (unsigned char) *s); s++) {
+        off -= 32;
+        if (off < 96)
+            gc_lookup(font, off, color, format, 1);
+    }
+}
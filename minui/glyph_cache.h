@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _MINUI_GLYPH_CACHE_H_
+#define _MINUI_GLYPH_CACHE_H_
+
+#include <pixelflinger/pixelflinger.h>
+#include "minui.h"
+
+/*
+ * Glyphs already expanded to the framebuffer format in one color, keyed
+ * by (font, glyph, color, format) and built from the 1bpp font glyphs.
+ * Text is drawn as spans copied from the cache; glyphs that can't be
+ * cached are expanded directly with bl_glyph1.
+ */
+
+/* Draws s at (x, y) (top of the glyph cells) clipped to (l, t)-(r, b),
+ * which must lie inside dst. The color alpha is ignored, like the
+ * GGL_REPLACE texture environment used for text does. Without create,
+ * missing glyphs are not added to the cache (see gc_prepare_text). */
+void gc_draw_text(GGLSurface *dst, GRFont *font, int x, int y, const char *s,
+                  int l, int t, int r, int b, unsigned char cr, unsigned char cg,
+                  unsigned char cb, int create);
+
+/* adds the glyphs of s to the cache, so that it can then be drawn from
+ * several threads at once with create unset */
+void gc_prepare_text(GRFont *font, int format, const char *s,
+                     unsigned char cr, unsigned char cg, unsigned char cb);
+
+/* drop every glyph, needed before a font is freed */
+void gc_flush(void);
+
+void gc_stats(struct gr_glyph_stats *st);
+
+#endif
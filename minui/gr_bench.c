@@ -0,0 +1,760 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * minui graphics benchmark.
+ *
+ * By default every gr_* primitive the UI uses is timed through the
+ * public API, once with the blitter fast path and once with plain
+ * pixelflinger, and reported as ns/call, percentiles and Mpixel/s.
+ * It draws to fb0, or to a memory surface with -f mem[:WxH[:fmt]]
+ * (same syntax as MINUI_FB), so device and host runs are comparable.
+ *
+ * usage: grbench [-n iterations] [-f fb0|mem...] [-p fast|pf] [-b bands] [-c] [-k] [-d]
+ *                [-r recording]
+ *   -b  time a full UI frame drawn in a batch split in 1 .. bands bands
+ *       (default: one per online cpu)
+ *   -c  one csv line per test:
+ *       test,path,calls,ns_mean,ns_p50,ns_p90,ns_p99,ns_max,mpixel_s
+ *   -k  compare the raw kernels with pixelflinger on off-screen surfaces,
+ *       text is the 1bpp glyph renderer against the A8 font texture
+ *   -d  time decoding the images of RES_IMAGES_FOLDER from .png and from
+ *       .qoi (see mkqoi), in the format drawn in
+ *   -r  time the input path (ev_get() and the virtual keys) replaying an
+ *       input recording (see MINUI_INPUT_RECORD) as fast as it goes
+ *
+ * MINUI_RENDER16=1 draws a 32bpp framebuffer through an RGB 565 surface,
+ * run the suite with and without it to compare.
+ *
+ * The asset_* tests blit the UI's images from RES_IMAGES_FOLDER, decoded
+ * to 8888 (the old res_create_surface) and to the format drawn in.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <linux/input.h>
+#include <pixelflinger/pixelflinger.h>
+
+#include "minui.h"
+#include "blitter.h"
+
+static int iterations = 200;
+static int max_bands = 0;
+static int csv = 0;
+static const char *path_name;
+
+static const struct { int format; const char *name; int size; } FORMATS[] = {
+    { GGL_PIXEL_FORMAT_RGB_565,   "RGB_565",   2 },
+    { GGL_PIXEL_FORMAT_RGBX_8888, "RGBX_8888", 4 },
+    { GGL_PIXEL_FORMAT_RGBA_8888, "RGBA_8888", 4 },
+    { GGL_PIXEL_FORMAT_BGRA_8888, "BGRA_8888", 4 },
+    { 0, NULL, 0 },
+};
+
+// libminui_bm calls it when the framebuffer can't be opened
+int led_alert(const char *color, int value)
+{
+    return 0;
+}
+
+// and to log input device errors
+void ui_print(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double*) a, y = *(const double*) b;
+    return x < y ? -1 : x > y;
+}
+
+static void init_surface(GGLSurface *s, int format, int size, int w, int h, int alpha)
+{
+    int i;
+    s->version = sizeof(GGLSurface);
+    s->width = w;
+    s->height = h;
+    s->stride = w;
+    s->format = format;
+    s->data = malloc(w * h * size);
+    for (i = 0; i < w * h * size; i++) {
+        // alpha sources get a ramp, so the blend paths can't shortcut
+        s->data[i] = alpha ? (i * 7) & 0xff : 0xff;
+    }
+}
+
+/*
+ * Primitive suite
+ */
+
+static int scr_w, scr_h;
+static GGLSurface *blit_src;
+static int text_font;
+static const char *TEXT = "Boot menu   > Recovery   > Tools";
+
+static void report(const char *test, double *ns, int pixels)
+{
+    double sum = 0;
+    int i, n = iterations;
+
+    qsort(ns, n, sizeof(*ns), cmp_double);
+    for (i = 0; i < n; i++)
+        sum += ns[i];
+
+    if (csv) {
+        printf("%s,%s,%d,%.0f,%.0f,%.0f,%.0f,%.0f,%.2f\n", test, path_name, n,
+               sum / n, ns[n / 2], ns[n * 9 / 10], ns[n * 99 / 100], ns[n - 1],
+               pixels * 1000.0 * n / sum);
+    } else {
+        printf("%-16s %-5s %10.0f %10.0f %10.0f %10.0f %9.1f\n", test, path_name,
+               sum / n, ns[n / 2], ns[n * 9 / 10], ns[n * 99 / 100],
+               pixels * 1000.0 * n / sum);
+    }
+}
+
+/* prepare runs untimed before each call, e.g. to give gr_flip some damage */
+static void run(const char *test, int pixels, void (*fn)(void), void (*prepare)(void))
+{
+    double *ns = malloc(iterations * sizeof(*ns));
+    double t;
+    int i;
+
+    // warm caches, glyph cache and the lazy back page restore
+    for (i = 0; i < 3; i++) {
+        if (prepare) prepare();
+        fn();
+    }
+    for (i = 0; i < iterations; i++) {
+        if (prepare) prepare();
+        t = now_ns();
+        fn();
+        ns[i] = now_ns() - t;
+    }
+    report(test, ns, pixels);
+    free(ns);
+
+    // don't let the damage of one test leak into the next one
+    gr_flip();
+}
+
+static void fill_opaque(void)
+{
+    gr_color(0, 0, 0, 255);
+    gr_fill(0, 0, scr_w, scr_h);
+}
+
+static void fill_alpha(void)
+{
+    gr_color(0, 0, 0, 160);
+    gr_fill(0, 0, scr_w, scr_h);
+}
+
+// a selected menu item
+static void fill_item(void)
+{
+    gr_color(0, 170, 255, 255);
+    gr_fill(0, 100, scr_w, 140);
+}
+
+static void line_1px(void)
+{
+    gr_color(255, 255, 255, 255);
+    gr_drawLine(0, 200, scr_w, 200, 1);
+}
+
+static void line_4px(void)
+{
+    gr_color(0, 170, 255, 255);
+    gr_drawLine(0, 200, scr_w, 200, 4);
+}
+
+static void line_diag(void)
+{
+    gr_color(255, 255, 255, 255);
+    gr_drawLine(0, 0, scr_w - 1, scr_w - 1, 1);
+}
+
+static void draw_rect(void)
+{
+    gr_color(255, 255, 255, 255);
+    gr_drawRect(10, 100, scr_w - 10, 140, 2);
+}
+
+static void blit_full(void)
+{
+    gr_blit(blit_src, 0, 0, scr_w, scr_h, 0, 0);
+}
+
+static void blit_icon(void)
+{
+    gr_blit(blit_src, 0, 0, 64, 64, 100, 100);
+}
+
+static int asset_w, asset_h;
+
+static void blit_asset(void)
+{
+    gr_blit(blit_src, 0, 0, asset_w, asset_h, 0, 0);
+}
+
+static void bench_asset(const char *asset)
+{
+    int rgb8888 = (gr_fb_format() == GGL_PIXEL_FORMAT_BGRA_8888) ?
+                  GGL_PIXEL_FORMAT_BGRA_8888 : GGL_PIXEL_FORMAT_RGBX_8888;
+    gr_surface s8888, snative;
+    char name[32];
+
+    if (res_create_surface_format(asset, &s8888, rgb8888, 0) < 0 ||
+        res_create_surface(asset, &snative) < 0)
+        return;
+    asset_w = gr_get_width(snative);
+    asset_h = gr_get_height(snative);
+    if (asset_w > scr_w) asset_w = scr_w;
+    if (asset_h > scr_h) asset_h = scr_h;
+
+    blit_src = s8888;
+    snprintf(name, sizeof(name), "asset_%s_8888", asset);
+    run(name, asset_w * asset_h, blit_asset, NULL);
+    blit_src = snative;
+    snprintf(name, sizeof(name), "asset_%s_fb", asset);
+    run(name, asset_w * asset_h, blit_asset, NULL);
+}
+
+static void text(void)
+{
+    gr_setfont(text_font);
+    gr_color(255, 255, 255, 255);
+    gr_text(0, 300, TEXT);
+}
+
+// half of the string is outside the clip rect, as in scrolled menus
+static void text_cut(void)
+{
+    gr_setfont(text_font);
+    gr_color(255, 255, 255, 255);
+    gr_text_cut(0, 300, TEXT, 0, gr_measure(TEXT) / 2, 0, scr_h);
+}
+
+static void flip(void)
+{
+    gr_flip();
+}
+
+static void damage_full(void)
+{
+    fill_opaque();
+}
+
+static void damage_item(void)
+{
+    fill_item();
+}
+
+// a full redraw of the menu with the log tail, like ui.c does
+static void frame(void)
+{
+    int i, cw, ch;
+
+    gr_batch_begin();
+    gr_color(0, 0, 0, 255);
+    gr_fill(0, 0, scr_w, scr_h);
+    gr_blit(blit_src, 0, 0, 64, 64, scr_w - 80, 16);
+    gr_color(50, 50, 50, 160);
+    gr_fill(0, 0, scr_w, scr_h);
+
+    gr_setfont(FONT_ITEM);
+    gr_font_size(&cw, &ch);
+    for (i = 0; i < 10; i++) {
+        int top = 100 + i * (ch + 16);
+        if (i == 3) {
+            gr_color(0, 170, 255, 255);
+            gr_fill(0, top, scr_w, top + ch + 16);
+        }
+        gr_color(255, 255, 255, 255);
+        gr_text(20, top + 8 + ch, TEXT);
+    }
+    gr_color(0, 170, 255, 255);
+    gr_drawLine(0, 90, scr_w, 90, 4);
+
+    gr_setfont(FONT_LOGS);
+    gr_font_size(&cw, &ch);
+    gr_color(192, 192, 192, 255);
+    for (i = 0; i < 8; i++)
+        gr_text(0, scr_h - (8 - i) * ch, TEXT);
+    gr_batch_end();
+}
+
+static void bench_suite(int fastpath)
+{
+    static const char *FONT_NAMES[] = { "head", "item", "logs" };
+    GGLSurface src;
+    char name[32];
+    int f;
+
+    gr_set_fastpath(fastpath);
+    path_name = fastpath ? "fast" : "pf";
+
+    run("fill", scr_w * scr_h, fill_opaque, NULL);
+    run("fill_alpha", scr_w * scr_h, fill_alpha, NULL);
+    run("fill_item", scr_w * 40, fill_item, NULL);
+    run("line_1px", scr_w, line_1px, NULL);
+    run("line_4px", scr_w * 4, line_4px, NULL);
+    run("line_diag", scr_w, line_diag, NULL);
+    run("rect_2px", (scr_w - 20 + 40) * 2 * 2, draw_rect, NULL);
+
+    for (f = 0; FORMATS[f].name; f++) {
+        init_surface(&src, FORMATS[f].format, FORMATS[f].size, scr_w, scr_h,
+                     FORMATS[f].format == GGL_PIXEL_FORMAT_RGBA_8888);
+        blit_src = &src;
+        snprintf(name, sizeof(name), "blit_%s", FORMATS[f].name);
+        run(name, scr_w * scr_h, blit_full, NULL);
+        snprintf(name, sizeof(name), "icon_%s", FORMATS[f].name);
+        run(name, 64 * 64, blit_icon, NULL);
+        free(src.data);
+    }
+    bench_asset("background");
+    bench_asset("progress_fill");
+
+    for (f = FONT_HEAD; f <= FONT_LOGS; f++) {
+        int cw, ch;
+        text_font = f;
+        gr_setfont(f);
+        gr_font_size(&cw, &ch);
+        snprintf(name, sizeof(name), "text_%s", FONT_NAMES[f]);
+        run(name, cw * ch * strlen(TEXT), text, NULL);
+        snprintf(name, sizeof(name), "text_cut_%s", FONT_NAMES[f]);
+        run(name, cw * ch * strlen(TEXT) / 2, text_cut, NULL);
+    }
+
+    run("flip_full", scr_w * scr_h, flip, damage_full);
+    run("flip_item", scr_w * 40, flip, damage_item);
+
+    // scaling of batched full redraws with the number of bands
+    init_surface(&src, FORMATS[0].format, FORMATS[0].size, 64, 64, 0);
+    blit_src = &src;
+    for (f = 1; f <= max_bands; f++) {
+        if (gr_set_bands(f) != f)
+            break;
+        snprintf(name, sizeof(name), "frame_%dband", f);
+        run(name, scr_w * scr_h * 2, frame, NULL);
+    }
+    gr_set_bands(1);
+    free(src.data);
+}
+
+/*
+ * Image decoding, libpng against QOI
+ */
+
+static double decode_us(const char *name, const char *ext)
+{
+    char path[256];
+    gr_surface s;
+    double t;
+    int i;
+
+    snprintf(path, sizeof(path), RES_IMAGES_FOLDER "/%s.%s", name, ext);
+    t = now_ns();
+    for (i = 0; i < iterations; i++) {
+        if (res_decode_surface(path, gr_draw_format(), 1, &s) < 0)
+            return -1;
+        res_free_surface(&s);
+    }
+    return (now_ns() - t) / iterations / 1000.0;
+}
+
+static void bench_decode(void)
+{
+    static const char *IMAGES[] = { "background", "indeterminate1",
+                                    "progress_empty", "progress_fill", NULL };
+    int i;
+
+    printf("%-16s %10s %10s %8s\n", "image", "png us", "qoi us", "speedup");
+    for (i = 0; IMAGES[i]; i++) {
+        double png = decode_us(IMAGES[i], "png");
+        double qoi = decode_us(IMAGES[i], "qoi");
+        if (png < 0 || qoi < 0)
+            printf("%-16s %10s\n", IMAGES[i], png < 0 ? "no png" : "no qoi");
+        else
+            printf("%-16s %10.0f %10.0f %7.1fx\n", IMAGES[i], png, qoi, png / qoi);
+    }
+}
+
+/*
+ * Input path, from a recording
+ */
+
+static void bench_input(const char *recording)
+{
+    struct input_event ev;
+    struct ev_stats st;
+    unsigned events = 0, given = 0;
+    double t, total = 0;
+    int stdout_fd;
+    int i;
+
+    // the replays log each device and their end to stdout
+    fflush(stdout);
+    stdout_fd = dup(1);
+    dup2(2, 1);
+    for (i = 0; i < iterations; i++) {
+        if (ev_replay(recording, 0) < 0)
+            break;
+        ev_init();
+        t = now_ns();
+        while (ev_replaying()) {
+            if (ev_get(&ev, 1) == 0)
+                given++;
+        }
+        total += now_ns() - t;
+    }
+    ev_get_stats(&st);
+    events = st.events;
+    ev_exit();
+    fflush(stdout);
+    dup2(stdout_fd, 1);
+    close(stdout_fd);
+    if (i < iterations) {
+        fprintf(stderr, "grbench: can't replay %s\n", recording);
+        return;
+    }
+
+    printf("%-16s %10s %10s %10s %12s\n", "input", "events", "handed out",
+           "ns/event", "Mevent/s");
+    printf("%-16s %10u %10u %10.0f %12.2f\n", "replay", events, given,
+           events ? total / events : 0, events ? events * 1e3 / total : 0);
+}
+
+/*
+ * Raw kernels against pixelflinger, without the gr_* overhead
+ */
+
+static void report_kernel(const char *fmt, const char *op, const char *path,
+                          double ms, int pixels)
+{
+    printf("%-10s %-14s %-12s %8.1f Mpixel/s\n", fmt, op, path,
+           (double) pixels * iterations / (ms * 1000.0));
+}
+
+static void set_color(GGLContext *gl, int a)
+{
+    GGLint color[4] = { 0x8080, 0x4040, 0xc0c0, ((a << 8) | a) + 1 };
+    gl->color4xv(gl, color);
+}
+
+static double now_ms(void)
+{
+    return now_ns() / 1e6;
+}
+
+/* a screen of text, 1bpp glyphs against the A8 texture */
+static void bench_text(GGLContext *gl, GGLSurface *dst, const char *name)
+{
+    // the menu font, as gr_text() draws it
+    GRFont *font = gr_get_font(FONT_ITEM);
+    unsigned pitch, size, pixel;
+    int cols, rows, pixels;
+    int i, x, y;
+    double t;
+
+    if (font == NULL) {
+        fprintf(stderr, "grbench: no font for the text kernels\n");
+        return;
+    }
+    pitch = font->pitch;
+    size = pitch * font->cheight;
+    pixel = bl_pack_color(dst->format, 255, 255, 255, 255);
+    cols = dst->width / font->cwidth;
+    rows = dst->height / font->cheight;
+    pixels = cols * rows * font->cwidth * font->cheight;
+
+    gl->bindTexture(gl, &font->texture);
+    gl->texEnvi(gl, GGL_TEXTURE_ENV, GGL_TEXTURE_ENV_MODE, GGL_REPLACE);
+    gl->texGeni(gl, GGL_S, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+    gl->texGeni(gl, GGL_T, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+    gl->enable(gl, GGL_TEXTURE_2D);
+    set_color(gl, 255);
+    t = now_ms();
+    for (i = 0; i < iterations; i++) {
+        for (y = 0; y < rows; y++) {
+            for (x = 0; x < cols; x++) {
+                int ch = (x + y) % 95 + 1;
+                int dx = x * font->cwidth, dy = y * font->cheight;
+                gl->texCoord2i(gl, ch * font->cwidth - dx, 0 - dy);
+                gl->recti(gl, dx, dy, dx + font->cwidth, dy + font->cheight);
+            }
+        }
+    }
+    report_kernel(name, "text", "pixelflinger", now_ms() - t, pixels);
+    gl->disable(gl, GGL_TEXTURE_2D);
+
+    t = now_ms();
+    for (i = 0; i < iterations; i++) {
+        for (y = 0; y < rows; y++) {
+            for (x = 0; x < cols; x++) {
+                int ch = (x + y) % 95 + 1;
+                bl_glyph1(dst, x * font->cwidth, y * font->cheight,
+                          font->glyphs + ch * size, pitch, font->cwidth,
+                          font->cheight, 0, 0, dst->width, dst->height, pixel);
+            }
+        }
+    }
+    report_kernel(name, "text", "glyph1", now_ms() - t, pixels);
+}
+
+static void bench_kernels(int width, int height)
+{
+    GGLContext *gl;
+    GGLSurface dst, src, asrc;
+    int f, i;
+    double t;
+
+    gglInit(&gl);
+    gl->activeTexture(gl, 0);
+    gl->enable(gl, GGL_BLEND);
+    gl->blendFunc(gl, GGL_SRC_ALPHA, GGL_ONE_MINUS_SRC_ALPHA);
+
+    for (f = 0; FORMATS[f].name; f++) {
+        const char *name = FORMATS[f].name;
+        int pixels = width * height;
+
+        if (FORMATS[f].format == GGL_PIXEL_FORMAT_RGBA_8888)
+            continue;
+
+        init_surface(&dst, FORMATS[f].format, FORMATS[f].size, width, height, 0);
+        init_surface(&src, FORMATS[f].format == GGL_PIXEL_FORMAT_RGB_565 ?
+                     GGL_PIXEL_FORMAT_RGB_565 : GGL_PIXEL_FORMAT_RGBX_8888,
+                     FORMATS[f].size, width, height, 0);
+        init_surface(&asrc, GGL_PIXEL_FORMAT_RGBA_8888, 4, width, height, 1);
+        gl->colorBuffer(gl, &dst);
+
+        /* opaque fill */
+        gl->disable(gl, GGL_TEXTURE_2D);
+        set_color(gl, 255);
+        t = now_ms();
+        for (i = 0; i < iterations; i++)
+            gl->recti(gl, 0, 0, width, height);
+        report_kernel(name, "fill", "pixelflinger", now_ms() - t, pixels);
+
+        t = now_ms();
+        for (i = 0; i < iterations; i++)
+            bl_fill(&dst, 0, 0, width, height, bl_pack_color(dst.format, 128, 64, 192, 255));
+        report_kernel(name, "fill", "kernel", now_ms() - t, pixels);
+
+        /* alpha fill */
+        set_color(gl, 160);
+        t = now_ms();
+        for (i = 0; i < iterations; i++)
+            gl->recti(gl, 0, 0, width, height);
+        report_kernel(name, "fill_alpha", "pixelflinger", now_ms() - t, pixels);
+
+        t = now_ms();
+        for (i = 0; i < iterations; i++)
+            bl_fill_blend(&dst, 0, 0, width, height, 128, 64, 192, 160);
+        report_kernel(name, "fill_alpha", "kernel", now_ms() - t, pixels);
+
+        /* 4px horizontal lines, one every 8 rows */
+        set_color(gl, 255);
+        t = now_ms();
+        for (i = 0; i < iterations; i++) {
+            int y;
+            for (y = 4; y < height; y += 8) {
+                GGLint v0[] = { 0, y * 16 }, v1[] = { width * 16, y * 16 };
+                gl->linex(gl, v0, v1, 4 * 16);
+            }
+        }
+        report_kernel(name, "line_4px", "pixelflinger", now_ms() - t, pixels / 2);
+
+        t = now_ms();
+        for (i = 0; i < iterations; i++) {
+            int y;
+            for (y = 4; y < height; y += 8)
+                bl_fill(&dst, 0, y - 2, width, y + 2, bl_pack_color(dst.format, 0, 170, 255, 255));
+        }
+        report_kernel(name, "line_4px", "kernel", now_ms() - t, pixels / 2);
+
+        /* same-format opaque blit, and alpha blit for 32bpp */
+        gl->bindTexture(gl, &src);
+        gl->texEnvi(gl, GGL_TEXTURE_ENV, GGL_TEXTURE_ENV_MODE, GGL_REPLACE);
+        gl->texGeni(gl, GGL_S, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+        gl->texGeni(gl, GGL_T, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+        gl->enable(gl, GGL_TEXTURE_2D);
+        gl->texCoord2i(gl, 0, 0);
+        t = now_ms();
+        for (i = 0; i < iterations; i++)
+            gl->recti(gl, 0, 0, width, height);
+        report_kernel(name, "blit", "pixelflinger", now_ms() - t, pixels);
+
+        t = now_ms();
+        for (i = 0; i < iterations; i++)
+            bl_blit(&dst, 0, 0, &src, 0, 0, width, height);
+        report_kernel(name, "blit", "kernel", now_ms() - t, pixels);
+
+        if (FORMATS[f].size == 4) {
+            gl->bindTexture(gl, &asrc);
+            t = now_ms();
+            for (i = 0; i < iterations; i++)
+                gl->recti(gl, 0, 0, width, height);
+            report_kernel(name, "blit_alpha", "pixelflinger", now_ms() - t, pixels);
+
+            t = now_ms();
+            for (i = 0; i < iterations; i++)
+                bl_blit(&dst, 0, 0, &asrc, 0, 0, width, height);
+            report_kernel(name, "blit_alpha", "kernel", now_ms() - t, pixels);
+
+            /* the copy flip of a 16bpp drawing surface (MINUI_RENDER16) */
+            GGLSurface src16;
+            init_surface(&src16, GGL_PIXEL_FORMAT_RGB_565, 2, width, height, 0);
+            gl->bindTexture(gl, &src16);
+            t = now_ms();
+            for (i = 0; i < iterations; i++)
+                gl->recti(gl, 0, 0, width, height);
+            report_kernel(name, "expand_565", "pixelflinger", now_ms() - t, pixels);
+
+            t = now_ms();
+            for (i = 0; i < iterations; i++)
+                bl_blit(&dst, 0, 0, &src16, 0, 0, width, height);
+            report_kernel(name, "expand_565", "kernel", now_ms() - t, pixels);
+            free(src16.data);
+        }
+
+        bench_text(gl, &dst, name);
+
+        free(dst.data);
+        free(src.data);
+        free(asrc.data);
+    }
+
+    gglUninit(gl);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: grbench [-n iterations] [-f fb0|mem[:WxH[:fmt]]] "
+                    "[-p fast|pf] [-b bands] [-c] [-k] [-d] [-r recording]\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *paths = NULL;
+    const char *recording = NULL;
+    int kernels = 0;
+    int decode = 0;
+    int stdout_fd;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:f:p:b:ckdr:")) != -1) {
+        switch (c) {
+        case 'n':
+            iterations = atoi(optarg);
+            if (iterations < 1)
+                usage();
+            break;
+        case 'f':
+            setenv("MINUI_FB", optarg, 1);
+            break;
+        case 'p':
+            paths = optarg;
+            break;
+        case 'b':
+            max_bands = atoi(optarg);
+            if (max_bands < 1)
+                usage();
+            break;
+        case 'c':
+            csv = 1;
+            break;
+        case 'k':
+            kernels = 1;
+            break;
+        case 'd':
+            decode = 1;
+            break;
+        case 'r':
+            recording = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+
+    // the asset tests decode twice, leave /cache alone
+    setenv("MINUI_RES_CACHE", "", 0);
+
+    // gr_init logs to stdout, keep the csv output clean
+    fflush(stdout);
+    stdout_fd = dup(1);
+    dup2(2, 1);
+    c = gr_init();
+    fflush(stdout);
+    dup2(stdout_fd, 1);
+    close(stdout_fd);
+    if (c < 0) {
+        fprintf(stderr, "grbench: can't open the framebuffer\n");
+        return 1;
+    }
+    scr_w = gr_fb_width();
+    scr_h = gr_fb_height();
+    if (max_bands == 0)
+        max_bands = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (kernels) {
+        bench_kernels(scr_w, scr_h);
+        gr_exit();
+        return 0;
+    }
+    if (decode) {
+        bench_decode();
+        gr_exit();
+        return 0;
+    }
+    if (recording) {
+        bench_input(recording);
+        gr_exit();
+        return 0;
+    }
+
+    if (csv)
+        printf("# grbench %dx%d fb=%s iterations=%d\n", scr_w, scr_h,
+               getenv("MINUI_FB") ? getenv("MINUI_FB") : "fb0", iterations);
+    else
+        printf("%-16s %-5s %10s %10s %10s %10s %9s\n", "test", "path",
+               "ns/call", "p50", "p90", "p99", "Mpixel/s");
+
+    if (paths == NULL || !strcmp(paths, "fast"))
+        bench_suite(1);
+    if (paths == NULL || !strcmp(paths, "pf"))
+        bench_suite(0);
+
+    gr_exit();
+    return 0;
+}
@@ -18,8 +18,11 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <linux/fb.h>
 #include <linux/kd.h>
@@ -46,7 +49,15 @@
 
 #define NUM_BUFFERS 2
 
+#ifndef FBIO_WAITFORVSYNC
+# define FBIO_WAITFORVSYNC _IOW('F', 0x20, __u32)
+#endif
+
 #include "minui.h"
+#include "blitter.h"
+#include "glyph_cache.h"
+#include "bands.h"
+#include "fb_mem.h"
 #include "font_10x18.h"
 #include "roboto_15x24.h"
 
@@ -60,29 +71,412 @@ static GGLSurface gr_framebuffer[NUM_BUFFERS];
 static GGLSurface gr_mem_surface;
 static unsigned gr_active_fb = 0;
 
-static void * gr_fontmem = NULL;
 static void * gr_bigfontmem = NULL;
 static int gr_fb_fd = -1;
 static int gr_vt_fd = -1;
 
 static int gr_vt_mode = -1;
 
+/* pixels of the framebuffer pages: the panel's native format when minui
+ * can draw it (see get_fbdev), else PIXEL_FORMAT, or the one asked of
+ * the memory framebuffer. BGR 565 is drawn as RGB 565 with red and blue
+ * swapped in gr_color. */
+static int gr_pixel_format = PIXEL_FORMAT;
+static int gr_pixel_size = PIXEL_SIZE;
+static int gr_colors_reversed = 0;
+/* 32bpp panels: draw into an RGB 565 memory surface, expanded to the
+ * framebuffer format on flip (BOARD_BOOTMENU_RENDER_16BPP) */
+static int gr_render16 = 0;
+/* kernels for the surface framebuffer drawing goes to, NULL if none */
+static const struct bl_ops *gr_fb_ops = NULL;
+
+/* headless: memory pages instead of fb0, see fb_mem.h */
+static int gr_headless = 0;
+static const char *gr_dump_pattern = NULL;
+static unsigned gr_dump_frame = 0;
+
 static struct fb_var_screeninfo vi;
 static struct fb_fix_screeninfo fi;
 
 static unsigned mmap_len = 0;
 
+/* framebuffer opened by gr_preload() in its current mode, taken over by
+ * get_framebuffer() */
+static struct {
+    int fd;
+    void *bits;
+    unsigned len;           // 0 for the memory framebuffer
+    int format, size;       // -1 if not preloaded
+    struct fb_var_screeninfo vi;
+    struct fb_fix_screeninfo fi;
+} gr_pre = { -1, NULL, 0, -1, 0 };
+
+/* splash: raw copy of the main menu saved by the last run, read into the
+ * visible page by the first gr_init() instead of clearing it, so the
+ * screen isn't black until the first frame */
+#define GR_SPLASH_MAGIC   0x50534d42 /* "BMSP" */
+#define GR_SPLASH_VERSION 1
+
+struct gr_splash_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;        // GGL_PIXEL_FORMAT_* of the page
+    uint32_t width;
+    uint32_t height;
+    uint32_t line_length;   // in bytes
+};  // followed by height * line_length bytes of pixels
+
+static void *gr_splash = NULL;  // page captured by gr_splash_capture()
+static int gr_splash_tried = 0;
+static int gr_splash_shown = 0;
+
+/* damage tracking, only the touched regions are copied on flip */
+#define MAX_DAMAGE_RECTS 16
+
+struct gr_rect {
+    int left, top, right, bottom;
+};
+
+struct gr_damage {
+    struct gr_rect rects[MAX_DAMAGE_RECTS];
+    int count;
+};
+
+/* [gr_damage_cur] is the frame being drawn, the other one the previous frame */
+static struct gr_damage gr_damage[2];
+static unsigned gr_damage_cur = 0;
+static unsigned gr_flip_copied = 0;
+
+/* direct mode: draw into the hidden page and pan to it on flip,
+ * used when the driver has a second page (see gr_init_flip) */
+static int gr_direct = 0;
+static unsigned gr_fb_pages = 1;
+/* direct mode: the back page misses these regions of the front page */
+static struct gr_damage gr_restore;
+static int gr_restore_pending = 0;
+static unsigned gr_frame_copied = 0;
+static unsigned char gr_color_alpha = 255;
+
+/* current color, as given to pixelflinger, for the blitter kernels */
+static unsigned char gr_rgba[4] = { 255, 255, 255, 255 };
+static int gr_fastpath = 1;
+
+/* offscreen target set by gr_set_target, drawn with (gr_target_x,
+ * gr_target_y) as origin, or NULL for the framebuffer */
+static GGLSurface *gr_target = NULL;
+static const struct bl_ops *gr_target_ops = NULL;
+static int gr_target_x = 0, gr_target_y = 0;
+
+/* framebuffer drawing is cut to this rect when gr_clipping (gr_set_clip) */
+static struct gr_rect gr_clip_rect;
+static int gr_clipping = 0;
+
+#ifndef BOARD_BOOTMENU_BANDS
+#  define BOARD_BOOTMENU_BANDS 1
+#endif
+static int gr_bands = 1;
+
+static void gr_init_flip(void);
+static void gr_batch_flush(void);
+
 static void gr_fb_clear(GGLSurface *fb) {
     if (fb && fb->data) {
-        memset(fb->data, 0, vi.yres * vi.xres * PIXEL_SIZE);
+        memset(fb->data, 0, vi.yres * vi.xres * gr_pixel_size);
     }
 }
 
+static int gr_rect_overlap(const struct gr_rect *a, const struct gr_rect *b)
+{
+    return a->left <= b->right && b->left <= a->right
+        && a->top <= b->bottom && b->top <= a->bottom;
+}
+
+static void gr_rect_union(struct gr_rect *a, const struct gr_rect *b)
+{
+    if (b->left < a->left) a->left = b->left;
+    if (b->top < a->top) a->top = b->top;
+    if (b->right > a->right) a->right = b->right;
+    if (b->bottom > a->bottom) a->bottom = b->bottom;
+}
+
+/* add a rect to a damage list, overlapping (or touching) rects are merged */
+static void gr_damage_merge(struct gr_damage *d, struct gr_rect r)
+{
+    int i;
+
+    if (r.left < 0) r.left = 0;
+    if (r.top < 0) r.top = 0;
+    if (r.right > (int) vi.xres) r.right = vi.xres;
+    if (r.bottom > (int) vi.yres) r.bottom = vi.yres;
+    if (r.left >= r.right || r.top >= r.bottom)
+        return;
+
+    for (i = 0; i < d->count; i++) {
+        if (gr_rect_overlap(&d->rects[i], &r)) {
+            gr_rect_union(&r, &d->rects[i]);
+            // the grown rect can now overlap others, restart with it
+            d->rects[i] = d->rects[--d->count];
+            i = -1;
+        }
+    }
+
+    if (d->count == MAX_DAMAGE_RECTS) {
+        // too fragmented, fall back to the bounding box
+        for (i = 1; i < d->count; i++)
+            gr_rect_union(&d->rects[0], &d->rects[i]);
+        gr_rect_union(&d->rects[0], &r);
+        d->count = 1;
+        return;
+    }
+    d->rects[d->count++] = r;
+}
+
+/* cut a framebuffer rect to gr_set_clip(), returns 0 if nothing is left */
+static int gr_clip_fb(int *l, int *t, int *r, int *b)
+{
+    if (!gr_clipping || gr_target)
+        return 1;
+    if (*l < gr_clip_rect.left) *l = gr_clip_rect.left;
+    if (*t < gr_clip_rect.top) *t = gr_clip_rect.top;
+    if (*r > gr_clip_rect.right) *r = gr_clip_rect.right;
+    if (*b > gr_clip_rect.bottom) *b = gr_clip_rect.bottom;
+    return *l < *r && *t < *b;
+}
+
+static void gr_damage_add(int left, int top, int right, int bottom)
+{
+    struct gr_rect r;
+    if (gr_target || !gr_clip_fb(&left, &top, &right, &bottom))
+        return;
+    r.left = left;
+    r.top = top;
+    r.right = right;
+    r.bottom = bottom;
+    gr_damage_merge(&gr_damage[gr_damage_cur], r);
+}
+
+/* the surface pixelflinger currently draws into */
+static GGLSurface *gr_draw_surface(void)
+{
+    if (gr_target)
+        return gr_target;
+    return gr_direct ? &gr_framebuffer[gr_active_fb ^ 1] : &gr_mem_surface;
+}
+
+/* the kernels to draw into it, NULL for pixelflinger only */
+static const struct bl_ops *gr_draw_ops(void)
+{
+    if (!gr_fastpath)
+        return NULL;
+    return gr_target ? gr_target_ops : gr_fb_ops;
+}
+
+/* clip a rect to a surface, returns 0 if nothing is left */
+static int gr_clip(const GGLSurface *s, int *l, int *t, int *r, int *b)
+{
+    if (*l < 0) *l = 0;
+    if (*t < 0) *t = 0;
+    if (*r > (int) s->width) *r = s->width;
+    if (*b > (int) s->height) *b = s->height;
+    return *l < *r && *t < *b;
+}
+
+static unsigned gr_copy_rect(GGLSurface *dst, GGLSurface *src, const struct gr_rect *r)
+{
+    unsigned char *d, *s;
+    int y, len = (r->right - r->left) * gr_pixel_size;
+
+    s = (unsigned char*) src->data + r->top * fi.line_length + r->left * gr_pixel_size;
+    d = (unsigned char*) dst->data + r->top * fi.line_length + r->left * gr_pixel_size;
+    if (len == (int) fi.line_length) {
+        memcpy(d, s, (r->bottom - r->top) * len);
+    } else {
+        for (y = r->top; y < r->bottom; y++) {
+            memcpy(d, s, len);
+            s += fi.line_length;
+            d += fi.line_length;
+        }
+    }
+    return (r->bottom - r->top) * len;
+}
+
+/* Direct mode: bring the back page up to date with the front page before
+ * the first drawing of a frame. Skipped when that drawing is an opaque
+ * rect covering everything missing (usually the background clear). */
+static void gr_restore_back(int left, int top, int right, int bottom, int opaque)
+{
+    int i;
+
+    if (!gr_restore_pending || gr_target)
+        return;
+    gr_restore_pending = 0;
+
+    if (opaque) {
+        for (i = 0; i < gr_restore.count; i++) {
+            struct gr_rect *r = &gr_restore.rects[i];
+            if (r->left < left || r->top < top || r->right > right || r->bottom > bottom)
+                break;
+        }
+        if (i == gr_restore.count)
+            return;
+    }
+
+    for (i = 0; i < gr_restore.count; i++) {
+        gr_frame_copied += gr_copy_rect(&gr_framebuffer[gr_active_fb ^ 1],
+                                        &gr_framebuffer[gr_active_fb],
+                                        &gr_restore.rects[i]);
+    }
+}
+
+void gr_damage_all(void)
+{
+    gr_damage[gr_damage_cur].count = 0;
+    gr_damage_add(0, 0, vi.xres, vi.yres);
+}
+
+unsigned gr_flip_bytes(void)
+{
+    return gr_flip_copied;
+}
+
 #ifndef DEFAULT_PAGE_SIZE
 #  define DEFAULT_PAGE_SIZE 4096
 #endif
 
+static void *get_fbdev(void);
+
+static int gr_splash_path(char *path, size_t size)
+{
+    const char *dir = res_cache_folder();
+
+    if (dir == NULL)
+        return -1;
+    if (snprintf(path, size, "%s/splash.fb", dir) >= (int) size)
+        return -1;
+    return 0;
+}
+
+static void gr_splash_header_init(struct gr_splash_header *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->magic = GR_SPLASH_MAGIC;
+    h->version = GR_SPLASH_VERSION;
+    h->format = gr_pixel_format;
+    h->width = vi.xres;
+    h->height = vi.yres;
+    h->line_length = fi.line_length;
+}
+
+/* one read of the splash into the page, if it was saved in this mode */
+static int gr_splash_show(GGLSurface *page)
+{
+    struct gr_splash_header h, cur;
+    char path[256];
+    size_t bytes;
+    int fd, ok;
+
+    if (gr_splash_tried || gr_splash_path(path, sizeof(path)) < 0)
+        return -1;
+    gr_splash_tried = 1;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    gr_splash_header_init(&cur);
+    bytes = (size_t) cur.height * cur.line_length;
+    ok = read(fd, &h, sizeof(h)) == (ssize_t) sizeof(h) &&
+         !memcmp(&h, &cur, sizeof(h)) &&
+         read(fd, page->data, bytes) == (ssize_t) bytes;
+    close(fd);
+    if (!ok)
+        return -1;
+
+    fprintf(stderr, "framebuffer: splash from %s\n", path);
+    gr_splash_shown = 1;
+    return 0;
+}
+
+/* maps the framebuffer pages into fb[0] and fb[1], returns 0 on success */
 static int get_framebuffer(GGLSurface *fb)
+{
+    void *bits;
+
+    // init to prevent free of random address
+    fb->data = NULL;
+
+    if (gr_headless && gr_pre.bits) {
+        bits = gr_pre.bits;
+        gr_pre.bits = NULL;
+        vi = gr_pre.vi;
+        fi = gr_pre.fi;
+        gr_pixel_format = gr_pre.format;
+        gr_pixel_size = vi.bits_per_pixel / 8;
+    } else if (gr_headless) {
+        bits = memfb_open(getenv("MINUI_FB"), &gr_pixel_format, &vi, &fi);
+        gr_pixel_size = vi.bits_per_pixel / 8;
+    } else {
+        bits = get_fbdev();
+    }
+    if (bits == NULL)
+        return -1;
+
+    fb->version = sizeof(*fb);
+    fb->width = vi.xres;
+    fb->height = vi.yres;
+    fb->stride = fi.line_length/gr_pixel_size;
+    fb->data = bits;
+    fb->format = gr_pixel_format;
+    if (gr_splash_show(fb) < 0)
+        gr_fb_clear(fb);
+
+    fb++;
+
+    fb->version = sizeof(*fb);
+    fb->width = vi.xres;
+    fb->height = vi.yres;
+    fb->stride = fi.line_length/gr_pixel_size;
+    fb->data = (void*) (((unsigned char*) bits) + vi.yres * fi.line_length);
+    fb->format = gr_pixel_format;
+
+    gr_fb_pages = fi.smem_len / (vi.yres * fi.line_length);
+    if (gr_fb_pages > NUM_BUFFERS)
+        gr_fb_pages = NUM_BUFFERS;
+    if (gr_fb_pages > 1) {
+        gr_fb_clear(fb);
+    } else {
+        // no room for a second page in the mapping
+        fb->data = fb[-1].data;
+    }
+
+    return 0;
+}
+
+/* GGL format of a fb mode, -1 if minui can't draw into it. 565 drivers
+ * don't report red and blue reliably, whether they are swapped is the
+ * board's choice (PIXELS_BGR_16BPP) whatever the offsets say. */
+static int gr_mode_format(const struct fb_var_screeninfo *v, int *reversed)
+{
+    *reversed = 0;
+    if (v->bits_per_pixel == 16 && v->green.offset == 5 && v->green.length == 6) {
+        if ((v->red.offset == 11 && v->blue.offset == 0)
+                || (v->red.offset == 0 && v->blue.offset == 11)) {
+#ifdef COLORS_REVERSED
+            *reversed = 1;
+#endif
+            return GGL_PIXEL_FORMAT_RGB_565;
+        }
+    } else if (v->bits_per_pixel == 32 && v->green.offset == 8 && v->green.length == 8) {
+        if (v->red.offset == 0 && v->blue.offset == 16)
+            return v->transp.length ? GGL_PIXEL_FORMAT_RGBA_8888 : GGL_PIXEL_FORMAT_RGBX_8888;
+        if (v->red.offset == 16 && v->blue.offset == 0)
+            return GGL_PIXEL_FORMAT_BGRA_8888;
+    }
+    return -1;
+}
+
+/* opens and maps fb0, in its current mode if minui can draw it (unless
+ * BOARD_BOOTMENU_FORCE_PIXELS), else in PIXEL_FORMAT. Sets gr_fb_fd. */
+static void *get_fbdev(void)
 {
     int fd;
     void *bits;
@@ -90,73 +484,90 @@ static int get_framebuffer(GGLSurface *fb)
     memset(&vi, 0, sizeof(vi));
     memset(&fi, 0, sizeof(fi));
 
-    // init to prevent free of random address
-    fb->data = NULL;
-
-    fd = open("/dev/graphics/fb0", O_RDWR);
+    fd = gr_pre.fd;
+    gr_pre.fd = -1;
+    if (fd < 0)
+        fd = open("/dev/graphics/fb0", O_RDWR);
     if (fd < 0) {
         perror("cannot open fb0");
-        return -1;
+        return NULL;
     }
 
     if (ioctl(fd, FBIOGET_VSCREENINFO, &vi) < 0) {
         perror("failed to get fb0 info");
         close(fd);
-        return -1;
+        return NULL;
     }
 
-    vi.bits_per_pixel = PIXEL_SIZE * 8;
-    if (PIXEL_FORMAT == GGL_PIXEL_FORMAT_RGBA_8888
-     || PIXEL_FORMAT == GGL_PIXEL_FORMAT_RGBX_8888) {
-      vi.red.offset     = 0;
-      vi.red.length     = 8;
-      vi.green.offset   = 8;
-      vi.green.length   = 8;
-      vi.blue.offset    = 16;
-      vi.blue.length    = 8;
-      vi.transp.offset  = 24;
-      vi.transp.length  = 8; //RGBX use 0xFF on Alpha
-    } else if (PIXEL_FORMAT == GGL_PIXEL_FORMAT_BGRA_8888) {
-      // defy cm7 config
-      vi.blue.offset    = 0;
-      vi.blue.length    = 8;
-      vi.green.offset   = 8;
-      vi.green.length   = 8;
-      vi.red.offset     = 16;
-      vi.red.length     = 8;
-      vi.transp.offset  = 24;
-      vi.transp.length  = 8;
-    } else {
+    gr_pixel_format = gr_mode_format(&vi, &gr_colors_reversed);
+#ifdef BOARD_BOOTMENU_FORCE_PIXELS
+    gr_pixel_format = -1;
+#endif
+    if (gr_pixel_format < 0) {
+        vi.bits_per_pixel = PIXEL_SIZE * 8;
+        if (PIXEL_FORMAT == GGL_PIXEL_FORMAT_RGBA_8888
+         || PIXEL_FORMAT == GGL_PIXEL_FORMAT_RGBX_8888) {
+          vi.red.offset     = 0;
+          vi.red.length     = 8;
+          vi.green.offset   = 8;
+          vi.green.length   = 8;
+          vi.blue.offset    = 16;
+          vi.blue.length    = 8;
+          vi.transp.offset  = 24;
+          vi.transp.length  = 8; //RGBX use 0xFF on Alpha
+        } else if (PIXEL_FORMAT == GGL_PIXEL_FORMAT_BGRA_8888) {
+          // defy cm7 config
+          vi.blue.offset    = 0;
+          vi.blue.length    = 8;
+          vi.green.offset   = 8;
+          vi.green.length   = 8;
+          vi.red.offset     = 16;
+          vi.red.length     = 8;
+          vi.transp.offset  = 24;
+          vi.transp.length  = 8;
+        } else {
 #ifdef COLORS_REVERSED
-      // BGR565 16-bits
-      vi.blue.offset    = 0;
-      vi.blue.length    = 5;
-      vi.green.offset   = 5;
-      vi.green.length   = 6;
-      vi.red.offset     = 11;
-      vi.red.length     = 5;
+          // BGR565 16-bits
+          vi.blue.offset    = 0;
+          vi.blue.length    = 5;
+          vi.green.offset   = 5;
+          vi.green.length   = 6;
+          vi.red.offset     = 11;
+          vi.red.length     = 5;
 #else
-      // RGB565 16-bits
-      vi.red.offset     = 0;
-      vi.red.length     = 5;
-      vi.green.offset   = 5;
-      vi.green.length   = 6;
-      vi.blue.offset    = 11;
-      vi.blue.length    = 5;
+          // RGB565 16-bits
+          vi.red.offset     = 0;
+          vi.red.length     = 5;
+          vi.green.offset   = 5;
+          vi.green.length   = 6;
+          vi.blue.offset    = 11;
+          vi.blue.length    = 5;
+#endif
+          vi.transp.offset  = 0;
+          vi.transp.length  = 0;
+        }
+        // the mode changes, so may the preloaded mapping
+        if (gr_pre.bits) {
+            munmap(gr_pre.bits, gr_pre.len);
+            gr_pre.bits = NULL;
+        }
+        if (ioctl(fd, FBIOPUT_VSCREENINFO, &vi) < 0) {
+            perror("failed to put fb0 info");
+            close(fd);
+            return NULL;
+        }
+
+        gr_pixel_format = PIXEL_FORMAT;
+#ifdef COLORS_REVERSED
+        gr_colors_reversed = 1;
 #endif
-      vi.transp.offset  = 0;
-      vi.transp.length  = 0;
-    }
-    if (ioctl(fd, FBIOPUT_VSCREENINFO, &vi) < 0) {
-        perror("failed to put fb0 info");
-        close(fd);
-        return -1;
     }
+    gr_pixel_size = vi.bits_per_pixel / 8;
 
     if (ioctl(fd, FBIOGET_FSCREENINFO, &fi) < 0) {
         perror("failed to get fb0 info");
         close(fd);
-        return -1;
+        return NULL;
     }
 
     /* adjust to be page-aligned */
@@ -166,32 +577,22 @@ static int get_framebuffer(GGLSurface *fb)
         mmap_len += (DEFAULT_PAGE_SIZE - adjust);
     }
 
-    bits = mmap(0, mmap_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    bits = gr_pre.bits;
+    if (bits && gr_pre.len != mmap_len) {
+        munmap(bits, gr_pre.len);
+        bits = NULL;
+    }
+    gr_pre.bits = NULL;
+    if (bits == NULL)
+        bits = mmap(0, mmap_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
     if (bits == MAP_FAILED) {
         perror("failed to mmap framebuffer");
         close(fd);
-        return -1;
+        return NULL;
     }
 
-    fb->version = sizeof(*fb);
-    fb->width = vi.xres;
-    fb->height = vi.yres;
-    fb->stride = fi.line_length/PIXEL_SIZE;
-    fb->data = bits;
-    fb->format = PIXEL_FORMAT;
-    gr_fb_clear(fb);
-
-    fb++;
-
-    fb->version = sizeof(*fb);
-    fb->width = vi.xres;
-    fb->height = vi.yres;
-    fb->stride = fi.line_length/PIXEL_SIZE;
-    fb->data = (void*) (((unsigned) bits) + vi.yres * fi.line_length);
-    fb->format = PIXEL_FORMAT;
-    gr_fb_clear(fb);
-
-    return fd;
+    gr_fb_fd = fd;
+    return bits;
 }
 
 static int release_framebuffer(GGLSurface *fb) {
@@ -202,8 +603,15 @@ static int release_framebuffer(GGLSurface *fb) {
     if (bits == NULL)
         return -2;
 
+    if (gr_headless) {
+        memfb_close(bits);
+        fb[0].data = fb[1].data = NULL;
+        return 0;
+    }
+
     close(gr_fb_fd);
     gr_fb_fd = -1;
+    fb[0].data = fb[1].data = NULL;
 
     if (mmap_len == 0)
         return -1;
@@ -221,13 +629,14 @@ int gr_fb_test(void)
 
     release_framebuffer(gr_framebuffer);
 
-    gr_fb_fd = get_framebuffer(gr_framebuffer);
-    if (gr_fb_fd < 0) {
+    if (get_framebuffer(gr_framebuffer) < 0) {
         led_alert("red", 1);
         gr_exit();
         return -1;
     }
 
+    gr_init_flip();
+
     return 0;
 }
 
@@ -235,10 +644,16 @@ static void get_memory_surface(GGLSurface* ms) {
     ms->version = sizeof(GGLSurface);
     ms->width = vi.xres;
     ms->height = vi.yres;
+    if (gr_render16) {
+        ms->stride = vi.xres;
+        ms->data = arena_alloc(&gr_arena, vi.yres * vi.xres * 2);
+        ms->format = GGL_PIXEL_FORMAT_RGB_565;
+        return;
+    }
     //ms->stride = vi.xres;
-    ms->stride = fi.line_length/PIXEL_SIZE;
-    ms->data = malloc(vi.yres * fi.line_length);
-    ms->format = PIXEL_FORMAT;
+    ms->stride = fi.line_length/gr_pixel_size;
+    ms->data = arena_alloc(&gr_arena, vi.yres * fi.line_length);
+    ms->format = gr_pixel_format;
 }
 
 static void set_active_framebuffer(unsigned n)
@@ -246,12 +661,60 @@ static void set_active_framebuffer(unsigned n)
     if (n > 1) return;
     vi.yres_virtual = vi.yres * NUM_BUFFERS;
     vi.yoffset = n * vi.yres;
-    vi.bits_per_pixel = PIXEL_SIZE * 8;
+    vi.bits_per_pixel = gr_pixel_size * 8;
+    if (gr_headless) return;
     if (ioctl(gr_fb_fd, FBIOPUT_VSCREENINFO, &vi) < 0) {
         perror("active fb swap failed");
     }
 }
 
+// lighter than a mode-set, once yres_virtual was set by set_active_framebuffer()
+static void pan_framebuffer(unsigned n)
+{
+    vi.yoffset = n * vi.yres;
+    if (gr_headless) return;
+    if (ioctl(gr_fb_fd, FBIOPAN_DISPLAY, &vi) < 0) {
+        perror("fb pan failed");
+        set_active_framebuffer(n);
+    }
+#ifdef BOARD_BOOTMENU_WAIT_VSYNC
+    __u32 crtc = 0;
+    ioctl(gr_fb_fd, FBIO_WAITFORVSYNC, &crtc);
+#endif
+}
+
+// choose between direct and copy flipping, and bind the drawing surface
+static void gr_init_flip(void)
+{
+    GGLContext *gl = gr_context;
+
+#ifndef BOARD_BOOTMENU_FLIP_COPY
+    // a 565 drawing surface can't be the page itself
+    gr_direct = (gr_fb_pages > 1 && !gr_render16);
+#endif
+
+    /* start with 0 as front (displayed) and 1 as back (drawing) */
+    gr_active_fb = 0;
+    gr_restore_pending = 0;
+    set_active_framebuffer(0);
+
+    if (gr_direct) {
+        gl->colorBuffer(gl, &gr_framebuffer[1]);
+    } else {
+        if (gr_mem_surface.data == NULL)
+            get_memory_surface(&gr_mem_surface);
+        gl->colorBuffer(gl, &gr_mem_surface);
+    }
+
+    fprintf(stderr, "framebuffer: %d page(s), %s flip%s\n",
+            gr_fb_pages, gr_direct ? "direct" : "copy",
+            gr_render16 ? " from rgb565" : "");
+
+    /* both pages have to be filled once */
+    gr_damage_all();
+    gr_damage[gr_damage_cur ^ 1] = gr_damage[gr_damage_cur];
+}
+
 // on bootmenu exit, set this final config
 static void set_final_framebuffer(void)
 {
@@ -262,6 +725,8 @@ static void set_final_framebuffer(void)
     vi.vmode = FB_VMODE_NONINTERLACED;
     vi.hsync_len = vi.vsync_len = 0;
 
+    if (gr_headless) return;
+
     if (ioctl(gr_fb_fd, FBIOPUT_VSCREENINFO, &vi) < 0) {
         perror("final fb swap failed");
     }
@@ -269,18 +734,113 @@ static void set_final_framebuffer(void)
 
 void gr_flip(void)
 {
-    GGLContext *gl = gr_context;
+    struct gr_damage copy;
+    struct gr_damage *prev = &gr_damage[gr_damage_cur ^ 1];
+    int i;
+
+    gr_batch_flush();
+    copy = gr_damage[gr_damage_cur];
+
+    if (gr_direct) {
+        /* the back page was drawn to, show it */
+        gr_restore_back(0, 0, 0, 0, 0);
+        gr_active_fb ^= 1;
+        pan_framebuffer(gr_active_fb);
+        GGLContext *gl = gr_context;
+        gl->colorBuffer(gl, &gr_framebuffer[gr_active_fb ^ 1]);
+
+        /* the new back page is one frame behind */
+        gr_restore = copy;
+        gr_restore_pending = 1;
+        gr_flip_copied = gr_frame_copied;
+        gr_frame_copied = 0;
+    } else {
+        /* swap front and back buffers */
+        if (gr_fb_pages > 1)
+            gr_active_fb = (gr_active_fb + 1) & 1;
+
+        /* the page we're about to make active was last updated two flips
+         * ago, so it misses this frame's damage and the previous one's */
+        for (i = 0; i < prev->count; i++)
+            gr_damage_merge(&copy, prev->rects[i]);
+
+        /* copy the damaged parts of the in-memory surface to it */
+        gr_flip_copied = 0;
+        for (i = 0; i < copy.count; i++) {
+            struct gr_rect *r = &copy.rects[i];
+            if (gr_render16) {
+                int w = r->right - r->left, h = r->bottom - r->top;
+                bl_blit(&gr_framebuffer[gr_active_fb], r->left, r->top,
+                        &gr_mem_surface, r->left, r->top, w, h);
+                gr_flip_copied += w * h * gr_pixel_size;
+                continue;
+            }
+            gr_flip_copied += gr_copy_rect(&gr_framebuffer[gr_active_fb],
+                                           &gr_mem_surface, r);
+        }
+
+        /* inform the display driver */
+        if (gr_fb_pages > 1)
+            set_active_framebuffer(gr_active_fb);
+    }
+
+    /* start a new frame with an empty damage list */
+    gr_damage_cur ^= 1;
+    gr_damage[gr_damage_cur].count = 0;
+
+    if (gr_dump_pattern) {
+        char path[256];
+        snprintf(path, sizeof(path), gr_dump_pattern, gr_dump_frame++);
+        gr_fb_dump_ppm(path);
+    }
+}
+
+int gr_splash_capture(void)
+{
+    size_t bytes = (size_t) vi.yres * fi.line_length;
+
+    if (gr_framebuffer[0].data == NULL)
+        return -1;
+    if (gr_splash == NULL)
+        gr_splash = arena_alloc(&gr_arena, bytes);
+    if (gr_splash == NULL)
+        return -1;
+    memcpy(gr_splash, gr_framebuffer[gr_active_fb].data, bytes);
+    return 0;
+}
 
-    /* swap front and back buffers */
-    gr_active_fb = (gr_active_fb + 1) & 1;
+int gr_splash_save(void)
+{
+    struct gr_splash_header h;
+    char path[256], tmpPath[sizeof(path) + 4];   // path + ".tmp"
+    size_t bytes;
+    int fd, ok;
 
-    /* copy data from the in-memory surface to the buffer we're about
-     * to make active. */
-    memcpy(gr_framebuffer[gr_active_fb].data, gr_mem_surface.data,
-           vi.yres * fi.line_length);
+    if (gr_splash == NULL || gr_splash_path(path, sizeof(path)) < 0)
+        return -1;
 
-    /* inform the display driver */
-    set_active_framebuffer(gr_active_fb);
+    gr_splash_header_init(&h);
+    bytes = (size_t) h.height * h.line_length;
+    mkdir(res_cache_folder(), 0755);
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+    ok = write(fd, &h, sizeof(h)) == (ssize_t) sizeof(h) &&
+         write(fd, gr_splash, bytes) == (ssize_t) bytes;
+    ok = (close(fd) == 0) && ok;
+    if (!ok || rename(tmpPath, path) < 0) {
+        unlink(tmpPath);
+        return -1;
+    }
+    return 0;
+}
+
+int gr_fb_dump_ppm(const char *path)
+{
+    if (gr_framebuffer[0].data == NULL)
+        return -1;
+    return memfb_dump_ppm(path, &gr_framebuffer[gr_active_fb]);
 }
 
 void gr_color(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
@@ -291,11 +851,26 @@ void gr_color(unsigned char r, unsigned char g, unsigned char b, unsigned char a
     color[1] = ((g << 8) | g) + 1;
     color[2] = ((b << 8) | b) + 1;
     color[3] = ((a << 8) | a) + 1;
-#ifdef COLORS_REVERSED
-    color[0] = ((b << 8) | b) + 1;
-    color[2] = ((r << 8) | r) + 1;
-#endif
+    if (gr_colors_reversed) {
+        color[0] = ((b << 8) | b) + 1;
+        color[2] = ((r << 8) | r) + 1;
+    }
     gl->color4xv(gl, color);
+    gr_color_alpha = a;
+
+    gr_rgba[0] = r;
+    gr_rgba[1] = g;
+    gr_rgba[2] = b;
+    gr_rgba[3] = a;
+    if (gr_colors_reversed) {
+        gr_rgba[0] = b;
+        gr_rgba[2] = r;
+    }
+}
+
+void gr_set_fastpath(int enable)
+{
+    gr_fastpath = enable;
 }
 
 void gr_set_uicolor(struct UiColor c) {
@@ -306,31 +881,292 @@ struct UiColor gr_make_uicolor(unsigned char r, unsigned char g, unsigned char b
     return c;
 }
 
+/*
+ * Decoded fonts are shared by every FONT_* slot using the same CFont, and
+ * only decoded the first time a slot is used. Text is drawn from 1bpp
+ * glyphs, the A8 texture is only built if pixelflinger has to draw text.
+ * CFONT_1BPP and CFONT_A8 fonts are used in place.
+ */
+struct gr_font_ref {
+    struct CFont *cfont;
+    GRFont *gr_font;
+    void *mem;          // A8 texture, NULL when unused or in place
+    void *glyph_mem;    // 1bpp glyphs, NULL when in place
+    int refs;
+};
+
+#define MAX_FONTS 3
+static struct gr_font_ref gr_font_refs[MAX_FONTS];
+
+static inline void gr_glyph_set(GRFont *font, unsigned x, unsigned y)
+{
+    unsigned ch = x / font->cwidth, gx = x % font->cwidth;
+    font->glyphs[(ch * font->cheight + y) * font->pitch + gx / 8] |= 0x80 >> (gx & 7);
+}
+
+static int gr_decode_font(struct gr_font_ref *ref, struct CFont *font_p)
+{
+    GRFont *font;
+    GGLSurface *ftex;
+    unsigned char *in, data;
+    unsigned n, i, x = 0, y = 0;
+
+    font = ref->gr_font = arena_calloc(&gr_arena, sizeof(*ref->gr_font));
+    if (font == NULL)
+        return -1;
+
+    font->cwidth = font_p->cwidth;
+    font->cheight = font_p->cheight;
+    font->ascent = font_p->cheight - 2;
+    font->pitch = (font_p->cwidth + 7) / 8;
+
+    ftex = &font->texture;
+    ftex->version = sizeof(*ftex);
+    ftex->width = font_p->width;
+    ftex->height = font_p->height;
+    ftex->stride = font_p->width;
+    ftex->format = GGL_PIXEL_FORMAT_A_8;
+
+    if (font_p->format == CFONT_1BPP) {
+        font->glyphs = font_p->rundata;
+        ref->cfont = font_p;
+        return 0;
+    }
+
+    font->glyphs = ref->glyph_mem = arena_calloc(&gr_arena, 96 * font->cheight * font->pitch);
+    if (font->glyphs == NULL) {
+        arena_free(&gr_arena, font);
+        ref->gr_font = NULL;
+        return -1;
+    }
+
+    if (font_p->format == CFONT_A8) {
+        ftex->data = font_p->rundata;
+        for (y = 0; y < font_p->height; y++)
+            for (x = 0; x < font_p->width; x++)
+                if (ftex->data[y * ftex->stride + x])
+                    gr_glyph_set(font, x, y);
+    } else {
+        in = font_p->rundata;
+        while((data = *in++)) {
+            n = data & 0x7f;
+            for (i = 0; i < n; i++) {
+                if (data & 0x80)
+                    gr_glyph_set(font, x, y);
+                if (++x == font_p->width) {
+                    x = 0;
+                    y++;
+                }
+            }
+        }
+    }
+
+    ref->cfont = font_p;
+    return 0;
+}
+
+// A8 texture of the font for pixelflinger, expanded from the glyphs
+static GGLSurface *gr_font_texture(GRFont *font)
+{
+    GGLSurface *ftex = &font->texture;
+    unsigned char *bits;
+    unsigned i, x, y;
+
+    if (ftex->data != NULL)
+        return ftex;
+
+    for (i = 0; i < MAX_FONTS; i++) {
+        if (gr_font_refs[i].gr_font == font)
+            break;
+    }
+    if (i == MAX_FONTS)
+        return NULL;
+
+    bits = arena_calloc(&gr_arena, ftex->width * ftex->height);
+    if (bits == NULL)
+        return NULL;
+    for (y = 0; y < font->cheight; y++) {
+        for (x = 0; x < ftex->width; x++) {
+            unsigned ch = x / font->cwidth, gx = x % font->cwidth;
+            if (font->glyphs[(ch * font->cheight + y) * font->pitch + gx / 8] & (0x80 >> (gx & 7)))
+                bits[y * ftex->stride + x] = 255;
+        }
+    }
+
+    gr_font_refs[i].mem = bits;
+    ftex->data = bits;
+    return ftex;
+}
+
+static GRFont *gr_load_font(int slot)
+{
+    struct UiFont *uifont = &FONTS[slot];
+    struct gr_font_ref *ref = NULL;
+    unsigned i;
+
+    if (uifont->gr_font != NULL)
+        return uifont->gr_font;
+
+    for (i = 0; i < MAX_FONTS; i++) {
+        if (gr_font_refs[i].cfont == uifont->cfont) {
+            ref = &gr_font_refs[i];
+            break;
+        }
+        if (ref == NULL && gr_font_refs[i].cfont == NULL)
+            ref = &gr_font_refs[i];
+    }
+    if (ref == NULL)
+        return NULL;
+
+    if (ref->cfont == NULL && gr_decode_font(ref, uifont->cfont) < 0) {
+        fprintf(stderr, "font: can't decode %ux%u font\n",
+                uifont->cfont->width, uifont->cfont->height);
+        return NULL;
+    }
+
+    ref->refs++;
+    uifont->gr_font = ref->gr_font;
+    uifont->gr_fontmem = ref->mem;
+    return uifont->gr_font;
+}
+
+static void gr_unload_font(int slot)
+{
+    struct UiFont *uifont = &FONTS[slot];
+    unsigned i;
+
+    if (uifont->gr_font == NULL)
+        return;
+
+    for (i = 0; i < MAX_FONTS; i++) {
+        struct gr_font_ref *ref = &gr_font_refs[i];
+        if (ref->gr_font != uifont->gr_font)
+            continue;
+        if (--ref->refs == 0) {
+            arena_free(&gr_arena, ref->mem);
+            arena_free(&gr_arena, ref->glyph_mem);
+            arena_free(&gr_arena, ref->gr_font);
+            memset(ref, 0, sizeof(*ref));
+        }
+        break;
+    }
+    uifont->gr_font = NULL;
+    uifont->gr_fontmem = NULL;
+}
+
+GRFont *gr_get_font(int slot)
+{
+    GRFont *font = gr_load_font(slot);
+
+    if (font == NULL || gr_font_texture(font) == NULL)
+        return NULL;
+    return font;
+}
+
+// selected font, decoded on first use
+static inline GRFont *gr_cur_font(void)
+{
+    GRFont *font = FONTS[selectedFont].gr_font;
+    return font ? font : gr_load_font(selectedFont);
+}
+
+static void gr_init_fonts(void)
+{
+    FONTS[FONT_HEAD].cfont = &bigfont;
+    FONTS[FONT_ITEM].cfont = &bigfont;
+    FONTS[FONT_LOGS].cfont = &font;
+}
+
 int gr_measure(const char *s)
 {
-    return FONTS[selectedFont].gr_font->cwidth * strlen(s);
+    return FONTS[selectedFont].cfont->cwidth * strlen(s);
 }
 
 void gr_font_size(int *x, int *y)
 {
-    if (FONTS[selectedFont].gr_font != NULL) {
-        *x = FONTS[selectedFont].gr_font->cwidth;
-        *y = FONTS[selectedFont].gr_font->cheight;
+    if (FONTS[selectedFont].cfont != NULL) {
+        *x = FONTS[selectedFont].cfont->cwidth;
+        *y = FONTS[selectedFont].cfont->cheight;
     }
 }
 
-int gr_text(int x, int y, const char *s)
+/*
+ * Every primitive ends up as a gr_cmd, in surface coordinates, run over
+ * a band of rows of the draw surface with a pixelflinger context for
+ * what the kernels can't do. Outside a batch it is run right away over
+ * the whole surface with gr_context. Inside one (gr_batch_begin), the
+ * framebuffer commands are recorded and replayed at gr_batch_end over
+ * gr_bands bands, one thread and one context per band.
+ */
+enum { GR_CMD_FILL, GR_CMD_CLEAR, GR_CMD_LINE, GR_CMD_BLIT, GR_CMD_TEXT };
+
+struct gr_cmd {
+    int op;
+    int fast;               // drawn by the blitter kernels
+    int l, t, r, b;         // rect for fills and blits, bounds otherwise
+    unsigned char rgba[4];
+    union {
+        struct { int ax, ay, bx, by, width; } line;
+        struct { GGLSurface *src; int sx, sy; } blit;
+        struct {
+            GRFont *font;
+            GGLSurface *tex;    // A8 texture, without fast
+            int x, y, minx, maxx, miny, maxy;
+            const char *s;
+            unsigned s_off;     // in gr_batch_text, while recorded
+        } text;
+    } u;
+};
+
+struct gr_band {
+    GGLContext *gl;
+    GGLSurface *dst;
+    const struct bl_ops *ops;   // kernels for dst, with fast commands
+    int top, bottom;
+    int replay;             // the glyph cache is shared, only read it
+};
+
+// below this many pixels a batch is replayed on the calling thread
+#define GR_BATCH_MIN_AREA (64 * 1024)
+
+static struct gr_cmd *gr_batch = NULL;
+static int gr_batch_count = 0, gr_batch_size = 0;
+static char *gr_batch_text = NULL;
+static unsigned gr_batch_text_len = 0, gr_batch_text_size = 0;
+static unsigned gr_batch_area = 0;
+static int gr_batch_split = 1;
+static int gr_batching = 0;
+static GGLContext *gr_band_gl[BANDS_MAX];
+
+static void gr_gl_color(GGLContext *gl, const unsigned char *rgba)
 {
-    return gr_text_cut(x,y,s,-1,-1,-1,-1);
+    GGLint color[4];
+    int i;
+
+    for (i = 0; i < 4; i++)
+        color[i] = ((rgba[i] << 8) | rgba[i]) + 1;
+    gl->color4xv(gl, color);
 }
 
-int gr_text_cut(int _x, int _y, const char *s, int minx, int maxx, int miny, int maxy) {
-    GGLContext *gl = gr_context;
-    GRFont *font = FONTS[selectedFont].gr_font;
+static void gr_text_pf(const struct gr_cmd *c, const struct gr_band *band)
+{
+    GGLContext *gl = band->gl;
+    GRFont *font = c->u.text.font;
+    const char *s = c->u.text.s;
+    int _x = c->u.text.x, _y = c->u.text.y;
+    int minx = c->u.text.minx, maxx = c->u.text.maxx;
+    int miny = c->u.text.miny, maxy = c->u.text.maxy;
     unsigned off;
-    _y -= font->ascent;
 
-    gl->bindTexture(gl, &font->texture);
+    // the band is one more clip
+    if (miny < band->top && band->top > 0)
+        miny = band->top;
+    if ((maxy < 0 || maxy > band->bottom) && band->bottom < (int) band->dst->height)
+        maxy = band->bottom;
+
+    // a band context has the color of its last command
+    gr_gl_color(gl, c->rgba);
+    gl->bindTexture(gl, c->u.text.tex);
     gl->texEnvi(gl, GGL_TEXTURE_ENV, GGL_TEXTURE_ENV_MODE, GGL_REPLACE);
     gl->texGeni(gl, GGL_S, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
     gl->texGeni(gl, GGL_T, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
@@ -376,25 +1212,362 @@ int gr_text_cut(int _x, int _y, const char *s, int minx, int maxx, int miny, int
       }
       _x += font->cwidth;
     }
+}
+
+static void gr_cmd_run(const struct gr_cmd *c, const struct gr_band *band)
+{
+    GGLContext *gl = band->gl;
+    GGLSurface *dst = band->dst;
+    const struct bl_ops *ops = band->ops;
+    int l = c->l, t = c->t, r = c->r, b = c->b;
+
+    if (t < band->top) t = band->top;
+    if (b > band->bottom) b = band->bottom;
+    if (t >= b)
+        return;
+
+    switch (c->op) {
+    case GR_CMD_FILL:
+        if (c->fast) {
+            if (gr_clip(dst, &l, &t, &r, &b))
+                ops->fill_blend(dst, l, t, r, b, c->rgba[0], c->rgba[1], c->rgba[2], c->rgba[3]);
+            break;
+        }
+        gr_gl_color(gl, c->rgba);
+        gl->disable(gl, GGL_TEXTURE_2D);
+        gl->recti(gl, l, t, r, b);
+        break;
+
+    case GR_CMD_CLEAR:
+        if (c->fast) {
+            ops->fill(dst, l, t, r, b, ops->pack(c->rgba[0], c->rgba[1], c->rgba[2], c->rgba[3]));
+            break;
+        }
+        gr_gl_color(gl, c->rgba);
+        gl->disable(gl, GGL_TEXTURE_2D);
+        gl->disable(gl, GGL_BLEND);
+        gl->recti(gl, l, t, r, b);
+        gl->enable(gl, GGL_BLEND);
+        break;
+
+    case GR_CMD_LINE: {
+        // no rect to cut, pixelflinger clips the line to its bounds
+        int v0[] = { c->u.line.ax*16, c->u.line.ay*16 };
+        int v1[] = { c->u.line.bx*16, c->u.line.by*16 };
+
+        if (!gr_clip(dst, &l, &t, &r, &b))
+            break;
+        gr_gl_color(gl, c->rgba);
+        gl->disable(gl, GGL_TEXTURE_2D);
+        gl->scissor(gl, l, t, r - l, b - t);
+        gl->enable(gl, GGL_SCISSOR_TEST);
+        gl->linex(gl, v0, v1, c->u.line.width*16);
+        gl->disable(gl, GGL_SCISSOR_TEST);
+        break;
+    }
+
+    case GR_CMD_BLIT:
+        if (c->fast) {
+            if (!gr_clip(dst, &l, &t, &r, &b))
+                break;
+            if (ops->blit(dst, l, t, c->u.blit.src, c->u.blit.sx + l - c->l,
+                        c->u.blit.sy + t - c->t, r - l, b - t))
+                break;
+            l = c->l;
+            r = c->r;
+        }
+        gl->bindTexture(gl, c->u.blit.src);
+        gl->texEnvi(gl, GGL_TEXTURE_ENV, GGL_TEXTURE_ENV_MODE, GGL_REPLACE);
+        gl->texGeni(gl, GGL_S, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+        gl->texGeni(gl, GGL_T, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+        gl->enable(gl, GGL_TEXTURE_2D);
+        gl->texCoord2i(gl, c->u.blit.sx - c->l, c->u.blit.sy - c->t);
+        gl->recti(gl, l, t, r, b);
+        break;
+
+    case GR_CMD_TEXT:
+        if (c->fast) {
+            gc_draw_text(dst, c->u.text.font, c->u.text.x, c->u.text.y, c->u.text.s,
+                         l, t, r, b, c->rgba[0], c->rgba[1], c->rgba[2], !band->replay);
+            break;
+        }
+        gr_text_pf(c, band);
+        break;
+    }
+}
+
+static void gr_batch_band(void *arg, int i)
+{
+    struct gr_band band;
+    GGLSurface *dst = arg;
+    int n;
+
+    band.gl = gr_band_gl[i];
+    band.dst = dst;
+    band.ops = gr_fb_ops;
+    band.top = dst->height * i / gr_batch_split;
+    band.bottom = dst->height * (i + 1) / gr_batch_split;
+    band.replay = 1;
+    band.gl->colorBuffer(band.gl, dst);
+
+    for (n = 0; n < gr_batch_count; n++)
+        gr_cmd_run(&gr_batch[n], &band);
+}
+
+static void gr_batch_flush(void)
+{
+    int i;
+
+    if (gr_batch_count == 0)
+        return;
+
+    // the text pool won't move anymore
+    for (i = 0; i < gr_batch_count; i++) {
+        if (gr_batch[i].op == GR_CMD_TEXT)
+            gr_batch[i].u.text.s = gr_batch_text + gr_batch[i].u.text.s_off;
+    }
+
+    gr_batch_split = (gr_batch_area >= GR_BATCH_MIN_AREA) ? gr_bands : 1;
+    if (gr_batch_split > 1)
+        bands_run(gr_batch_band, gr_draw_surface());
+    else
+        gr_batch_band(gr_draw_surface(), 0);
+
+    gr_batch_count = 0;
+    gr_batch_text_len = 0;
+    gr_batch_area = 0;
+}
+
+// adds a command to the batch, returns 0 if there's no room left
+static int gr_batch_add(const struct gr_cmd *c)
+{
+    GGLSurface *dst = gr_draw_surface();
+    struct gr_cmd *cmd;
+    int l = c->l, t = c->t, r = c->r, b = c->b;
+
+    if (gr_batch_count == gr_batch_size) {
+        int size = gr_batch_size ? gr_batch_size * 2 : 64;
+        cmd = arena_realloc(&gr_arena, gr_batch, size * sizeof(*cmd));
+        if (cmd == NULL)
+            return 0;
+        gr_batch = cmd;
+        gr_batch_size = size;
+    }
+
+    cmd = &gr_batch[gr_batch_count];
+    *cmd = *c;
+
+    if (c->op == GR_CMD_TEXT) {
+        unsigned len = strlen(c->u.text.s) + 1;
+        if (gr_batch_text_len + len > gr_batch_text_size) {
+            unsigned size = (gr_batch_text_size + len) * 2;
+            char *text = arena_realloc(&gr_arena, gr_batch_text, size);
+            if (text == NULL)
+                return 0;
+            gr_batch_text = text;
+            gr_batch_text_size = size;
+        }
+        memcpy(gr_batch_text + gr_batch_text_len, c->u.text.s, len);
+        cmd->u.text.s = NULL;
+        cmd->u.text.s_off = gr_batch_text_len;
+        gr_batch_text_len += len;
+
+        // only the recording thread may add glyphs
+        if (c->fast)
+            gc_prepare_text(c->u.text.font, dst->format, c->u.text.s,
+                            c->rgba[0], c->rgba[1], c->rgba[2]);
+    }
+
+    if (gr_clip(dst, &l, &t, &r, &b))
+        gr_batch_area += (r - l) * (b - t);
+    gr_batch_count++;
+    return 1;
+}
+
+/* cut a framebuffer command to gr_set_clip(), returns 0 if nothing is left */
+static int gr_clip_cmd(struct gr_cmd *c)
+{
+    int l = c->l, t = c->t, r = c->r, b = c->b;
+
+    if (!gr_clip_fb(&l, &t, &r, &b))
+        return 0;
+    if (c->op == GR_CMD_BLIT) {
+        c->u.blit.sx += l - c->l;
+        c->u.blit.sy += t - c->t;
+    } else if (c->op == GR_CMD_TEXT) {
+        if (c->u.text.minx < l) c->u.text.minx = l;
+        if (c->u.text.miny < t) c->u.text.miny = t;
+        if (c->u.text.maxx < 0 || c->u.text.maxx > r) c->u.text.maxx = r;
+        if (c->u.text.maxy < 0 || c->u.text.maxy > b) c->u.text.maxy = b;
+    }
+    c->l = l;
+    c->t = t;
+    c->r = r;
+    c->b = b;
+    return 1;
+}
+
+static void gr_submit(const struct gr_cmd *cmd)
+{
+    struct gr_cmd clipped;
+    const struct gr_cmd *c = cmd;
+    struct gr_band band;
+
+    if (gr_clipping && gr_target == NULL) {
+        clipped = *cmd;
+        if (!gr_clip_cmd(&clipped))
+            return;
+        c = &clipped;
+    }
+
+    if (gr_batching && gr_target == NULL) {
+        if (gr_batch_add(c))
+            return;
+        gr_batch_flush();
+    }
 
-    return _x;
+    band.gl = gr_context;
+    band.dst = gr_draw_surface();
+    band.ops = gr_target ? gr_target_ops : gr_fb_ops;
+    band.top = 0;
+    band.bottom = band.dst->height;
+    band.replay = 0;
+    gr_cmd_run(c, &band);
+}
+
+int gr_text(int x, int y, const char *s)
+{
+    return gr_text_cut(x,y,s,-1,-1,-1,-1);
+}
+
+int gr_text_cut(int _x, int _y, const char *s, int minx, int maxx, int miny, int maxy) {
+    GRFont *font = gr_cur_font();
+    struct gr_cmd c;
+    if (font == NULL)
+        return _x;
+    int end = _x + font->cwidth * strlen(s);
+
+    // to target coordinates, a clip edge before the origin is the origin
+    _x -= gr_target_x;
+    _y -= gr_target_y + font->ascent;
+    if (minx >= 0) minx = minx > gr_target_x ? minx - gr_target_x : 0;
+    if (maxx >= 0) maxx = maxx > gr_target_x ? maxx - gr_target_x : 0;
+    if (miny >= 0) miny = miny > gr_target_y ? miny - gr_target_y : 0;
+    if (maxy >= 0) maxy = maxy > gr_target_y ? maxy - gr_target_y : 0;
+
+    gr_restore_back(0, 0, 0, 0, 0);
+    if (!*s)
+        return end;
+
+    int left = _x, top = _y;
+    int right = _x + font->cwidth * strlen(s);
+    int bottom = _y + font->cheight;
+    if (minx >= 0 && left < minx) left = minx;
+    if (miny >= 0 && top < miny) top = miny;
+    if (maxx >= 0 && right > maxx) right = maxx;
+    if (maxy >= 0 && bottom > maxy) bottom = maxy;
+    gr_damage_add(left, top, right, bottom);
+
+    GGLSurface *dst = gr_draw_surface();
+    c.op = GR_CMD_TEXT;
+    c.fast = gr_draw_ops() != NULL;
+    if (c.fast) {
+        if (minx < 0) left = 0;
+        if (miny < 0) top = 0;
+        if (maxx < 0) right = dst->width;
+        if (maxy < 0) bottom = dst->height;
+        if (!gr_clip(dst, &left, &top, &right, &bottom))
+            return end;
+    } else {
+        c.u.text.tex = gr_font_texture(font);
+        if (c.u.text.tex == NULL)
+            return end;
+    }
+    c.l = left;
+    c.t = top;
+    c.r = right;
+    c.b = bottom;
+    memcpy(c.rgba, gr_rgba, 4);
+    c.u.text.font = font;
+    c.u.text.x = _x;
+    c.u.text.y = _y;
+    c.u.text.minx = minx;
+    c.u.text.maxx = maxx;
+    c.u.text.miny = miny;
+    c.u.text.maxy = maxy;
+    c.u.text.s = s;
+    gr_submit(&c);
+    return end;
+}
+
+// fill the rect (l, t)-(r, b), with the kernels when they can
+static void gr_submit_fill(int l, int t, int r, int b)
+{
+    struct gr_cmd c;
+
+    c.op = GR_CMD_FILL;
+    c.fast = gr_draw_ops() != NULL;
+    c.l = l;
+    c.t = t;
+    c.r = r;
+    c.b = b;
+    memcpy(c.rgba, gr_rgba, 4);
+    gr_submit(&c);
 }
 
 void gr_fill(int x, int y, int w, int h)
 {
-    GGLContext *gl = gr_context;
-    gl->disable(gl, GGL_TEXTURE_2D);
-    gl->recti(gl, x, y, w, h);
+    x -= gr_target_x;
+    w -= gr_target_x;
+    y -= gr_target_y;
+    h -= gr_target_y;
+    if (gr_clip_fb(&x, &y, &w, &h))
+        gr_restore_back(x, y, w, h, gr_color_alpha == 255);
+    else
+        gr_restore_back(0, 0, 0, 0, 0);
+    gr_submit_fill(x, y, w, h);
+    gr_damage_add(x, y, w, h);
 }
 
 void gr_drawLine(int ax, int ay, int bx, int by, int width)
 {
-    GGLContext *gl = gr_context;
-    gl->disable(gl, GGL_TEXTURE_2D);
+    struct gr_cmd c;
+    ax -= gr_target_x;
+    bx -= gr_target_x;
+    ay -= gr_target_y;
+    by -= gr_target_y;
+    gr_restore_back(0, 0, 0, 0, 0);
+
+    // line is centered on the segment, round the half width up
+    c.l = (ax < bx ? ax : bx) - width/2 - 1;
+    c.t = (ay < by ? ay : by) - width/2 - 1;
+    c.r = (ax > bx ? ax : bx) + width/2 + 1;
+    c.b = (ay > by ? ay : by) + width/2 + 1;
+    gr_damage_add(c.l, c.t, c.r, c.b);
+
+    /* thin axis-aligned lines are rects, pixelflinger draws them as a quad
+     * centered on the segment with the top edge included */
+    if (width >= 1 && width <= 4 && (ay == by || ax == bx)
+            && gr_draw_ops() != NULL) {
+        if (ay == by) {
+            int t = ay - (width + 1) / 2;
+            gr_submit_fill(ax < bx ? ax : bx, t, ax < bx ? bx : ax, t + width);
+        } else {
+            int l = ax - (width + 1) / 2;
+            gr_submit_fill(l, ay < by ? ay : by, l + width, ay < by ? by : ay);
+        }
+        return;
+    }
 
-    int v0[] = {ax*16,ay*16};
-    int v1[] = {bx*16,by*16};
-    gl->linex(gl, v0, v1, width*16);
+    c.op = GR_CMD_LINE;
+    c.fast = 0;
+    memcpy(c.rgba, gr_rgba, 4);
+    c.u.line.ax = ax;
+    c.u.line.ay = ay;
+    c.u.line.bx = bx;
+    c.u.line.by = by;
+    c.u.line.width = width;
+    gr_submit(&c);
 }
 
 void gr_drawRect(int ax, int ay, int bx, int by, int width)
@@ -406,18 +1579,154 @@ void gr_drawRect(int ax, int ay, int bx, int by, int width)
 }
 
 void gr_blit(gr_surface source, int sx, int sy, int w, int h, int dx, int dy) {
+    GGLSurface *src = (GGLSurface*) source;
+    struct gr_cmd c;
     if (gr_context == NULL) {
         return;
     }
+    dx -= gr_target_x;
+    dy -= gr_target_y;
+
+    gr_restore_back(0, 0, 0, 0, 0);
+    gr_damage_add(dx, dy, dx + w, dy + h);
+
+    /* in-bounds blits between compatible formats skip pixelflinger */
+    c.op = GR_CMD_BLIT;
+    c.fast = gr_draw_ops() != NULL && sx >= 0 && sy >= 0 && w > 0 && h > 0
+             && sx + w <= (int) src->width && sy + h <= (int) src->height;
+    c.l = dx;
+    c.t = dy;
+    c.r = dx + w;
+    c.b = dy + h;
+    c.u.blit.src = src;
+    c.u.blit.sx = sx;
+    c.u.blit.sy = sy;
+    gr_submit(&c);
+}
+
+gr_surface gr_create_surface(int width, int height, int alpha)
+{
+    GGLSurface *surface;
+    int format = gr_draw_format();
+    int size = gr_render16 ? 2 : gr_pixel_size;
+
+    // keep the byte order of the framebuffer so blits don't swap
+    if (alpha) {
+        format = (gr_pixel_format == GGL_PIXEL_FORMAT_BGRA_8888) ?
+                 GGL_PIXEL_FORMAT_BGRA_8888 : GGL_PIXEL_FORMAT_RGBA_8888;
+        size = 4;
+    }
+
+    surface = arena_calloc(&gr_arena, sizeof(GGLSurface) + width * height * size);
+    if (surface == NULL)
+        return NULL;
+    surface->version = sizeof(GGLSurface);
+    surface->width = width;
+    surface->height = height;
+    surface->stride = width;
+    surface->format = format;
+    surface->data = (unsigned char*) (surface + 1);
+    return (gr_surface) surface;
+}
+
+void gr_free_surface(gr_surface surface)
+{
+    // a pending blit may still read it
+    gr_batch_flush();
+    if (surface == gr_target)
+        gr_set_target(NULL, 0, 0);
+    arena_free(&gr_arena, surface);
+}
+
+void gr_set_target(gr_surface surface, int x, int y)
+{
     GGLContext *gl = gr_context;
 
-    gl->bindTexture(gl, (GGLSurface*) source);
-    gl->texEnvi(gl, GGL_TEXTURE_ENV, GGL_TEXTURE_ENV_MODE, GGL_REPLACE);
-    gl->texGeni(gl, GGL_S, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
-    gl->texGeni(gl, GGL_T, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
-    gl->enable(gl, GGL_TEXTURE_2D);
-    gl->texCoord2i(gl, sx - dx, sy - dy);
-    gl->recti(gl, dx, dy, dx + w, dy + h);
+    // targets are drawn right away, the batch may blit from this one
+    if (surface)
+        gr_batch_flush();
+    gr_target = (GGLSurface*) surface;
+    gr_target_ops = gr_target ? bl_get_ops(gr_target->format) : NULL;
+    gr_target_x = gr_target ? x : 0;
+    gr_target_y = gr_target ? y : 0;
+    gl->colorBuffer(gl, gr_draw_surface());
+}
+
+void gr_set_clip(int left, int top, int right, int bottom)
+{
+    gr_clip_rect.left = left;
+    gr_clip_rect.top = top;
+    gr_clip_rect.right = right;
+    gr_clip_rect.bottom = bottom;
+    gr_clipping = 1;
+}
+
+void gr_reset_clip(void)
+{
+    gr_clipping = 0;
+}
+
+void gr_clear(void)
+{
+    GGLSurface *dst = gr_draw_surface();
+    struct gr_cmd c;
+    int l = 0, t = 0, r = dst->width, b = dst->height;
+
+    if (gr_clip_fb(&l, &t, &r, &b))
+        gr_restore_back(l, t, r, b, 1);
+    else
+        gr_restore_back(0, 0, 0, 0, 0);
+    gr_damage_add(0, 0, dst->width, dst->height);
+
+    c.op = GR_CMD_CLEAR;
+    c.fast = gr_draw_ops() != NULL;
+    c.l = 0;
+    c.t = 0;
+    c.r = dst->width;
+    c.b = dst->height;
+    memcpy(c.rgba, gr_rgba, 4);
+    gr_submit(&c);
+}
+
+void gr_batch_begin(void)
+{
+    gr_batching = (gr_bands > 1);
+}
+
+void gr_batch_end(void)
+{
+    gr_batch_flush();
+    gr_batching = 0;
+}
+
+int gr_set_bands(int n)
+{
+    int i;
+
+    gr_batch_flush();
+    bands_stop();
+    for (i = 0; i < BANDS_MAX; i++) {
+        if (gr_band_gl[i]) {
+            gglUninit(gr_band_gl[i]);
+            gr_band_gl[i] = NULL;
+        }
+    }
+
+    gr_bands = (n > 1) ? bands_start(n) : 1;
+    for (i = 0; gr_bands > 1 && i < gr_bands; i++) {
+        GGLContext *gl;
+        if (gglInit(&gr_band_gl[i]) < 0) {
+            gr_band_gl[i] = NULL;
+            return gr_set_bands(1);
+        }
+        gl = gr_band_gl[i];
+        gl->activeTexture(gl, 0);
+        gl->enable(gl, GGL_BLEND);
+        gl->blendFunc(gl, GGL_SRC_ALPHA, GGL_ONE_MINUS_SRC_ALPHA);
+    }
+    if (gr_bands == 1)
+        gr_batching = 0;
+    return gr_bands;
 }
 
 unsigned int gr_get_width(gr_surface surface) {
@@ -434,63 +1743,115 @@ unsigned int gr_get_height(gr_surface surface) {
     return ((GGLSurface*) surface)->height;
 }
 
-static struct UiFont gr_init_font(struct CFont *font_p)
+void gr_glyph_cache_stats(struct gr_glyph_stats *st)
 {
-    struct UiFont uifont;
-    GGLSurface *ftex;
-    unsigned char *bits, *rle;
-    unsigned char *in, data;
-    int i;
-
-    uifont.gr_font = calloc(sizeof(*uifont.gr_font), 1);
-    uifont.cfont = font_p;
-    ftex = &uifont.gr_font->texture;
-
-    bits = malloc(font_p->width * font_p->height);
-    uifont.gr_fontmem = (void *) bits;
-
-    ftex->version = sizeof(*ftex);
-    ftex->width = font_p->width;
-    ftex->height = font_p->height;
-    ftex->stride = font_p->width;
-    ftex->data = (void*) bits;
-    ftex->format = GGL_PIXEL_FORMAT_A_8;
+    gc_stats(st);
+}
 
-    in = font_p->rundata;
-    while((data = *in++)) {
-        memset(bits, (data & 0x80) ? 255 : 0, data & 0x7f);
-        bits += (data & 0x7f);
-    }
+static void gr_free_fonts(void)
+{
+    gc_flush();
 
-    uifont.gr_font->cwidth = font_p->cwidth;
-    uifont.gr_font->cheight = font_p->cheight;
-    uifont.gr_font->ascent = font_p->cheight - 2;
+    gr_unload_font(FONT_HEAD);
+    gr_unload_font(FONT_ITEM);
+    gr_unload_font(FONT_LOGS);
+}
 
-    return uifont;
+static int gr_use_headless(void)
+{
+    const char *fb = getenv("MINUI_FB");
+#ifdef BOARD_BOOTMENU_HEADLESS
+    return (fb == NULL || strcmp(fb, "fb0") != 0);
+#else
+    return (fb != NULL && strncmp(fb, "mem", 3) == 0);
+#endif
 }
 
-static void gr_init_fonts(void)
+/* whether a framebuffer of that format is drawn through an RGB 565 surface */
+static int gr_use_render16(int format, int pixel_size)
 {
-    FONTS[FONT_HEAD] = gr_init_font(&bigfont);
-    FONTS[FONT_ITEM] = gr_init_font(&bigfont);
-    FONTS[FONT_LOGS] = gr_init_font(&font);
+    int render16 = 0;
+#ifdef BOARD_BOOTMENU_RENDER_16BPP
+    render16 = 1;
+#endif
+    const char *env = getenv("MINUI_RENDER16");
+    if (env)
+        render16 = atoi(env);
+    // only 8888 pages the kernels can expand to
+    return render16 && pixel_size == 4 && bl_get_ops(format) != NULL;
 }
 
-static void gr_free_font(struct UiFont *uifont)
+int gr_preload(void)
 {
-    // free font allocs
-    if (uifont->gr_fontmem) free(uifont->gr_fontmem);
-    uifont->gr_fontmem = NULL;
+    struct fb_var_screeninfo *pvi = &gr_pre.vi;
+    struct fb_fix_screeninfo *pfi = &gr_pre.fi;
+    int fd, reversed;
 
-    if (uifont->gr_font) free(uifont->gr_font);
-    uifont->gr_font = NULL;
+    gr_init_fonts();
+    gr_load_font(FONT_HEAD);
+    gr_load_font(FONT_ITEM);
+    gr_load_font(FONT_LOGS);
+
+    if (gr_pre.format < 0 && gr_use_headless()) {
+        gr_pre.format = PIXEL_FORMAT;
+        gr_pre.bits = memfb_open(getenv("MINUI_FB"), &gr_pre.format, pvi, pfi);
+        gr_pre.size = pvi->bits_per_pixel / 8;
+        if (gr_pre.bits == NULL)
+            gr_pre.format = -1;
+    } else if (gr_pre.format < 0) {
+        fd = open("/dev/graphics/fb0", O_RDWR);
+        if (fd < 0)
+            return -1;
+        if (ioctl(fd, FBIOGET_VSCREENINFO, pvi) < 0 ||
+            ioctl(fd, FBIOGET_FSCREENINFO, pfi) < 0) {
+            close(fd);
+            return -1;
+        }
+        gr_pre.fd = fd;
+        gr_pre.format = gr_mode_format(pvi, &reversed);
+        gr_pre.size = pvi->bits_per_pixel / 8;
+#ifdef BOARD_BOOTMENU_FORCE_PIXELS
+        gr_pre.format = -1;
+#endif
+        if (gr_pre.format < 0) {
+            // gr_init() switches the mode, and maps the pages then
+            gr_pre.format = PIXEL_FORMAT;
+            gr_pre.size = PIXEL_SIZE;
+        } else {
+            // the length get_fbdev() maps, populated now rather than on
+            // first access with drivers that fault pages in
+            gr_pre.len = (pfi->smem_len + DEFAULT_PAGE_SIZE - 1) & ~(DEFAULT_PAGE_SIZE - 1);
+#ifdef MAP_POPULATE
+            gr_pre.bits = mmap(0, gr_pre.len, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, fd, 0);
+#else
+            gr_pre.bits = mmap(0, gr_pre.len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+#endif
+            if (gr_pre.bits == MAP_FAILED)
+                gr_pre.bits = NULL;
+        }
+    }
+
+    if (gr_pre.format < 0)
+        return -1;
+    return gr_use_render16(gr_pre.format, gr_pre.size) ?
+           GGL_PIXEL_FORMAT_RGB_565 : gr_pre.format;
 }
 
-static void gr_free_fonts(void)
+void gr_preload_release(void)
 {
-    gr_free_font(&FONTS[FONT_HEAD]);
-    gr_free_font(&FONTS[FONT_ITEM]);
-    gr_free_font(&FONTS[FONT_LOGS]);
+    if (gr_pre.bits) {
+        if (gr_pre.len)
+            munmap(gr_pre.bits, gr_pre.len);
+        else
+            memfb_close(gr_pre.bits);
+    }
+    if (gr_pre.fd >= 0)
+        close(gr_pre.fd);
+    gr_pre.bits = NULL;
+    gr_pre.fd = -1;
+    gr_pre.format = -1;
+    gr_free_fonts();
 }
 
 int gr_init(void)
@@ -500,53 +1861,107 @@ int gr_init(void)
 
     gr_mem_surface.data = NULL;
 
+    gr_headless = gr_use_headless();
+    gr_dump_pattern = getenv("MINUI_FB_DUMP");
+
     gr_init_fonts();
-    gr_vt_fd = open("/dev/tty0", O_RDWR | O_SYNC);
-    if (gr_vt_fd < 0) {
-        gr_vt_fd = open("/dev/tty", O_RDWR | O_SYNC);
-    }
-    if (gr_vt_fd < 0) {
-        // This is non-fatal; post-Cupcake kernels don't have tty0.
-        perror("can't open /dev/tty");
-    } else {
-        ioctl(gr_vt_fd, KDGETMODE, &gr_vt_mode);
-        if (ioctl(gr_vt_fd, KDSETMODE, (void*) KD_GRAPHICS)) {
-            // However, if we do open tty0, we expect the ioctl to work.
-            perror("failed KDSETMODE to KD_GRAPHICS on tty");
-            //gr_exit();
-            //return -1;
+
+    // the console is left alone for the memory framebuffer, and stays
+    // in graphics mode across gr_release()
+    if (!gr_headless && gr_vt_fd == -1) {
+        gr_vt_fd = open("/dev/tty0", O_RDWR | O_SYNC);
+        if (gr_vt_fd < 0) {
+            gr_vt_fd = open("/dev/tty", O_RDWR | O_SYNC);
+        }
+        if (gr_vt_fd < 0) {
+            // This is non-fatal; post-Cupcake kernels don't have tty0.
+            perror("can't open /dev/tty");
+        } else {
+            ioctl(gr_vt_fd, KDGETMODE, &gr_vt_mode);
+            if (ioctl(gr_vt_fd, KDSETMODE, (void*) KD_GRAPHICS)) {
+                // However, if we do open tty0, we expect the ioctl to work.
+                perror("failed KDSETMODE to KD_GRAPHICS on tty");
+                //gr_exit();
+                //return -1;
+            }
         }
     }
 
-    gr_fb_fd = get_framebuffer(gr_framebuffer);
-    if (gr_fb_fd < 0) {
+    if (get_framebuffer(gr_framebuffer) < 0) {
         perror("unable to get framebuffer");
         gr_exit();
         return -1;
     }
-
-    get_memory_surface(&gr_mem_surface);
+    // what gr_preload() opened has been taken over
+    gr_pre.format = -1;
 
     fprintf(stderr, "framebuffer: fd %d (%d x %d)\n",
             gr_fb_fd, gr_framebuffer[0].width, gr_framebuffer[0].height);
 
-    /* start with 0 as front (displayed) and 1 as back (drawing) */
-    gr_active_fb = 0;
-    set_active_framebuffer(0);
-    gl->colorBuffer(gl, &gr_mem_surface);
+    gr_fb_ops = bl_get_ops(gr_pixel_format);
+    fprintf(stderr, "framebuffer: %d bpp, %s%s\n", gr_pixel_size * 8,
+            gr_fb_ops ? gr_fb_ops->name : "pixelflinger only",
+            gr_colors_reversed ? " (bgr)" : "");
+
+    gr_render16 = gr_use_render16(gr_pixel_format, gr_pixel_size);
+    if (gr_render16)
+        gr_fb_ops = bl_get_ops(GGL_PIXEL_FORMAT_RGB_565);
+
+    gr_init_flip();
 
     gl->activeTexture(gl, 0);
     gl->enable(gl, GGL_BLEND);
     gl->blendFunc(gl, GGL_SRC_ALPHA, GGL_ONE_MINUS_SRC_ALPHA);
 
-    gr_fb_blank(true);
+    const char *bands = getenv("MINUI_BANDS");
+    gr_set_bands(bands ? atoi(bands) : BOARD_BOOTMENU_BANDS);
+
+    // no power cycle of the panel while it shows the splash
+    if (!gr_splash_shown)
+        gr_fb_blank(true);
     gr_fb_blank(false);
+    gr_splash_shown = 0;
 
     return 0;
 }
 
+void gr_release(void)
+{
+    if (gr_context != NULL) {
+        // draws what's pending and stops the band workers
+        gr_set_bands(1);
+    }
+    arena_free(&gr_arena, gr_batch);
+    arena_free(&gr_arena, gr_batch_text);
+    gr_batch = NULL;
+    gr_batch_text = NULL;
+    gr_batch_size = gr_batch_text_size = 0;
+
+    // free memory buffer
+    if (gr_mem_surface.version == sizeof(GGLSurface) && gr_mem_surface.data) {
+        arena_free(&gr_arena, gr_mem_surface.data);
+        gr_mem_surface.data = NULL;
+    }
+
+    gr_free_fonts();
+
+    arena_free(&gr_arena, gr_splash);
+    gr_splash = NULL;
+
+    // un-mmap, the picture and the fb mode stay
+    release_framebuffer(gr_framebuffer);
+
+    if (gr_context != NULL) {
+        gglUninit(gr_context);
+        gr_context = NULL;
+    }
+}
+
 void gr_exit(void)
 {
+    if (gr_context != NULL)
+        gr_set_bands(1);
+
     // restore original vt mode (text or graphic)
     if (gr_vt_mode != -1)
         ioctl(gr_vt_fd, KDSETMODE, &gr_vt_mode);
@@ -556,26 +1971,29 @@ void gr_exit(void)
         close(gr_vt_fd);
         gr_vt_fd = -1;
     }
+    gr_vt_mode = -1;
 
-    // black screen before resolution change by bootanimation.
-    // both are required to prevent some weird bunnies display
-    gr_fb_clear(&gr_framebuffer[0]);
-    gr_fb_clear(&gr_framebuffer[1]);
+    // mapped again if gr_release() let it go
+    if (gr_framebuffer[0].data != NULL || get_framebuffer(gr_framebuffer) == 0) {
+        // black screen before resolution change by bootanimation.
+        // both are required to prevent some weird bunnies display
+        gr_fb_clear(&gr_framebuffer[0]);
+        gr_fb_clear(&gr_framebuffer[1]);
 
-    set_final_framebuffer();
-
-    // free memory buffer
-    if (gr_mem_surface.version == sizeof(GGLSurface) && gr_mem_surface.data) {
-        free(gr_mem_surface.data);
-        gr_mem_surface.data = NULL;
+        set_final_framebuffer();
     }
 
-    gr_free_fonts();
+    gr_release();
+}
 
-    // un-mmap
-    release_framebuffer(gr_framebuffer);
+int gr_fb_format(void)
+{
+    return gr_pixel_format;
+}
 
-    gglUninit(gr_context);
+int gr_draw_format(void)
+{
+    return gr_render16 ? GGL_PIXEL_FORMAT_RGB_565 : gr_pixel_format;
 }
 
 int gr_fb_width(void)
@@ -590,6 +2008,11 @@ int gr_fb_height(void)
 
 gr_pixel *gr_fb_data(void)
 {
+    gr_batch_flush();
+    if (gr_direct) {
+        gr_restore_back(0, 0, 0, 0, 0);
+        return (unsigned short *) gr_framebuffer[gr_active_fb ^ 1].data;
+    }
     return (unsigned short *) gr_mem_surface.data;
 }
 
@@ -597,6 +2020,9 @@ void gr_fb_blank(bool blank)
 {
     int ret;
 
+    if (gr_headless)
+        return;
+
     ret = ioctl(gr_fb_fd, FBIOBLANK, blank ? FB_BLANK_POWERDOWN : FB_BLANK_UNBLANK);
     if (ret < 0)
         perror("ioctl(): blank");
@@ -604,14 +2030,15 @@ void gr_fb_blank(bool blank)
 
 void gr_setfont(int i) {
     selectedFont = i;
+    gr_load_font(i);
 }
 
 int gr_getfont_cwidth() {
-    return FONTS[selectedFont].gr_font->cwidth;
+    return FONTS[selectedFont].cfont->cwidth;
 }
 
 int gr_getfont_cheight() {
-    return FONTS[selectedFont].gr_font->cheight;
+    return FONTS[selectedFont].cfont->cheight;
 }
 
 int gr_getfont_cheightfix() {
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stress test of the bootmenu key queue (key_queue.c).
+ *
+ * A producer thread pushes sequence-numbered keys and touches, with runs
+ * of drags, while the main thread reads them the way ui_wait_input()
+ * does, pausing now and then so that the queue fills up. It checks that:
+ *   - events come out in strictly increasing order, whole;
+ *   - a missing event is either a counted drop, or a drag replaced by
+ *     the drag that came right after it;
+ *   - the queue stats add up to what was seen.
+ *
+ * usage: kqstress [-n events] [-s seed]
+ * Exits 1 on the first failed check.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "key_queue.h"
+
+#define DRAG UINPUTEVENT_TYPE_TOUCH_DRAG
+
+static unsigned count = 2000000;
+static unsigned seed = 1;
+
+// per sequence number, index 0 unused and count + 1 the last event
+static unsigned char *types;
+static unsigned char *dropped;      // by a full queue
+static unsigned char *replaced;     // coalesced into the next drag
+static unsigned char *received;
+static unsigned last_retries;       // drops of the last event, pushed again
+
+static void fail(const char *fmt, unsigned seq)
+{
+    fprintf(stderr, "kqstress: ");
+    fprintf(stderr, fmt, seq);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+static void make_event(struct ui_input_event *ev, unsigned seq, int type)
+{
+    memset(ev, 0, sizeof(*ev));
+    ev->utype = type;
+    ev->value = seq;
+    // checked on the way out, a torn copy would not match
+    ev->posx = seq * 3;
+    ev->posy = ~seq;
+    types[seq] = type;
+}
+
+// 'q' queued, 'c' coalesced or 'd' dropped, from the stats that moved
+static int push(const struct ui_input_event *ev)
+{
+    struct ui_queue_stats before, after;
+
+    key_queue_get_stats(&before);
+    key_queue_push(ev);
+    key_queue_get_stats(&after);
+    if (after.coalesced != before.coalesced)
+        return 'c';
+    if (after.dropped != before.dropped)
+        return 'd';
+    return 'q';
+}
+
+static void *producer(void *cookie)
+{
+    struct ui_input_event ev;
+    unsigned seq, in_queue = 0;
+    unsigned r = seed;
+    int drags = -1;     // left in the current touch, -1 if none
+
+    for (seq = 1; seq <= count; seq++) {
+        int type;
+
+        if (drags > 0) {
+            type = DRAG;
+            drags--;
+        } else if (drags == 0) {
+            type = UINPUTEVENT_TYPE_TOUCH_RELEASE;
+            drags = -1;
+        } else if (rand_r(&r) % 4 == 0) {
+            type = UINPUTEVENT_TYPE_KEY;
+        } else {
+            type = UINPUTEVENT_TYPE_TOUCH_START;
+            drags = rand_r(&r) % 64;
+        }
+        make_event(&ev, seq, type);
+
+        switch (push(&ev)) {
+        case 'c':
+            // the event last queued, not read yet
+            replaced[in_queue] = 1;
+            in_queue = seq;
+            break;
+        case 'd':
+            dropped[seq] = 1;
+            break;
+        default:
+            in_queue = seq;
+        }
+
+        // lets the reader catch up and sleep on an empty queue
+        if (rand_r(&r) % 512 == 0)
+            usleep(rand_r(&r) % 500);
+    }
+
+    // the reader stops at this one, so it has to get in
+    make_event(&ev, seq, UINPUTEVENT_TYPE_KEY);
+    while (push(&ev) == 'd') {
+        last_retries++;
+        usleep(1000);
+    }
+    return NULL;
+}
+
+static void check(void)
+{
+    struct ui_queue_stats st;
+    unsigned seq, next;
+    unsigned n_received = 0, n_dropped = 0, n_replaced = 0;
+
+    for (seq = 1; seq <= count + 1; seq++) {
+        if (received[seq] + dropped[seq] + replaced[seq] != 1)
+            fail("event %u lost, or accounted twice", seq);
+        n_received += received[seq];
+        n_dropped += dropped[seq];
+        if (!replaced[seq])
+            continue;
+        n_replaced++;
+        // only a drag directly followed by another may be coalesced
+        for (next = seq + 1; dropped[next]; next++)
+            ;
+        if (types[seq] != DRAG || types[next] != DRAG)
+            fail("event %u coalesced, but not between two drags", seq);
+    }
+
+    key_queue_get_stats(&st);
+    if (st.depth != 0)
+        fail("%u events left in the queue", st.depth);
+    if (st.queued != n_received || st.coalesced != n_replaced
+            || st.dropped != n_dropped + last_retries)
+        fail("stats don't add up (%u queued)", st.queued);
+
+    printf("kqstress: %u events, %u read, %u coalesced, %u dropped, max depth %u: ok\n",
+           count, n_received - 1, n_replaced, n_dropped, st.max_depth);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: kqstress [-n events] [-s seed]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    struct ui_input_event ev;
+    pthread_t t;
+    unsigned last = 0;
+    unsigned r;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:s:")) != -1) {
+        switch (c) {
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            if (count < 1)
+                usage();
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage();
+        }
+    }
+    r = ~seed;
+
+    types = calloc(count + 2, 1);
+    dropped = calloc(count + 2, 1);
+    replaced = calloc(count + 2, 1);
+    received = calloc(count + 2, 1);
+    if (!types || !dropped || !replaced || !received) {
+        fprintf(stderr, "kqstress: out of memory\n");
+        return 1;
+    }
+
+    pthread_create(&t, NULL, producer, NULL);
+
+    while (last != count + 1) {
+        unsigned seq;
+
+        if (key_queue_pop(&ev) < 0) {
+            key_queue_wait();
+            continue;
+        }
+        seq = ev.value;
+        if (seq <= last || seq > count + 1)
+            fail("event %u out of order", seq);
+        if (ev.utype != types[seq] || ev.posx != (int) (seq * 3)
+                || ev.posy != (int) ~seq)
+            fail("event %u garbled", seq);
+        received[seq] = 1;
+        last = seq;
+
+        // a slow reader now and then, for full queues
+        if (rand_r(&r) % 4096 == 0)
+            usleep(rand_r(&r) % 2000);
+    }
+
+    pthread_join(t, NULL);
+    check();
+    return 0;
+}
@@ -18,6 +18,8 @@
 #define _MINUI_H_
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
 #include <pixelflinger/pixelflinger.h>
 
 typedef void* gr_surface;
@@ -31,13 +33,41 @@ struct UiColor {
 };
 
 int gr_init(void);
+// black screen and final fb mode for the next boot stage, then gr_release()
 void gr_exit(void);
+// frees what gr_init() got and unmaps the framebuffer, leaving the picture,
+// the fb mode and the console as they are; gr_init() again to draw
+void gr_release(void);
+// Decodes the fonts and opens the framebuffer ahead of gr_init(), without
+// changing the display, e.g. from a thread while other work goes on.
+// Returns the format gr_init() will draw in, or -1 if not known yet.
+int gr_preload(void);
+// releases what gr_preload() got, when gr_init() won't be called
+void gr_preload_release(void);
 
 int gr_fb_width(void);
 int gr_fb_height(void);
+// GGL_PIXEL_FORMAT_* of the framebuffer, known after gr_init()
+int gr_fb_format(void);
+// GGL_PIXEL_FORMAT_* drawn in, RGB 565 when rendering at 16bpp
+int gr_draw_format(void);
+// pixels being drawn, RGB 565 when rendering at 16bpp on a 32bpp panel
 gr_pixel *gr_fb_data(void);
 void gr_flip(void);
+// gr_flip() only copies the regions drawn during the last two frames,
+// call gr_damage_all() after writing to gr_fb_data() directly.
+void gr_damage_all(void);
+// bytes copied to the framebuffer by the last gr_flip()
+unsigned gr_flip_bytes(void);
 void gr_fb_blank(bool blank);
+// writes the visible page as a PPM image, returns 0 on success
+int gr_fb_dump_ppm(const char *path);
+// Keeps a copy of the visible page, gr_splash_save() writes it to
+// splash.fb in the cache folder. The next run's gr_init() reads it back
+// into the visible page if the mode is the same, instead of a black
+// screen until the first frame. Both return 0 on success.
+int gr_splash_capture(void);
+int gr_splash_save(void);
 
 void gr_color(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
 void gr_set_uicolor(struct UiColor c);
@@ -51,6 +81,41 @@ int gr_measure(const char *s);
 void gr_font_size(int *x, int *y);
 
 void gr_blit(gr_surface source, int sx, int sy, int w, int h, int dx, int dy);
+// offscreen surface in the format drawn to (the framebuffer's, or 565 at
+// 16bpp), or 8888 with alpha (all transparent) if alpha is set, to render
+// into with gr_set_target
+gr_surface gr_create_surface(int width, int height, int alpha);
+void gr_free_surface(gr_surface surface);
+// draw into surface instead of the framebuffer, (x, y) being the screen
+// position of its top left pixel. NULL goes back to the framebuffer, which
+// must be done before gr_flip().
+void gr_set_target(gr_surface surface, int x, int y);
+// Cut framebuffer drawing (not targets) to the screen rect (left, top)-
+// (right, bottom) until gr_reset_clip(), damage included: a frame can
+// redraw only what changed and gr_flip() copies only that.
+void gr_set_clip(int left, int top, int right, int bottom);
+void gr_reset_clip(void);
+// set every pixel of the target to the current color, alpha included
+void gr_clear(void);
+// use the blitter kernels when possible (default), or always pixelflinger
+void gr_set_fastpath(int enable);
+// Framebuffer drawing between these is recorded and rasterized at
+// gr_batch_end() by one thread per band of rows (no-op with one band).
+// Surfaces blitted in a batch must stay alive until its end.
+void gr_batch_begin(void);
+void gr_batch_end(void);
+// number of bands (and threads) for batches, returns the one in effect;
+// defaults to BOARD_BOOTMENU_BANDS or $MINUI_BANDS
+int gr_set_bands(int n);
+
+struct gr_glyph_stats {
+  unsigned hits;
+  unsigned misses;
+  unsigned entries;
+  unsigned bytes;
+};
+// text drawn through the pre-colored glyph cache
+void gr_glyph_cache_stats(struct gr_glyph_stats *st);
 unsigned int gr_get_width(gr_surface surface);
 unsigned int gr_get_height(gr_surface surface);
 void gr_setfont(int i);
@@ -61,30 +126,116 @@ int gr_getfont_cheightfix();
 
 // input event structure, include <linux/input.h> for the definition.
 // see http://www.mjmwired.net/kernel/Documentation/input/ for info.
+// ev_get() returns them stamped with CLOCK_MONOTONIC.
 struct input_event;
 
+// Opens the input devices, or resumes them if they are already open.
+// Devices plugged in later are added as they appear in /dev/input.
 int ev_init(void);
 void ev_exit(void);
+// Stop handing out events without closing the devices, a blocked
+// ev_get() returns -1. ev_resume() drops what came in between.
+void ev_suspend(void);
+void ev_resume(void);
 int ev_get(struct input_event *ev, unsigned dont_wait);
+// Writes the devices and every event read to path, NULL or "" stops,
+// also started by ev_init() from $MINUI_INPUT_RECORD.
+int ev_record(const char *path);
+// Before ev_init(), reads the devices and events from a recording (file
+// or pipe) instead of /dev/input, at speed times the recorded pace, or as
+// fast as ev_get() is called if speed is 0. ev_init() also takes them
+// from $MINUI_INPUT_REPLAY and $MINUI_INPUT_REPLAY_SPEED.
+int ev_replay(const char *path, double speed);
+// 1 until the end of the recording being replayed
+int ev_replaying(void);
+
+// Events are read in batches into a ring per device, and handed out one
+// by one before polling again.
+struct ev_stats {
+  unsigned polls;     // epoll_wait() calls
+  unsigned reads;     // read() calls
+  unsigned events;    // events read
+  unsigned packets;   // SYN_REPORT read
+  unsigned cpu_ms;    // cpu time of the thread calling ev_get()
+};
+void ev_get_stats(struct ev_stats *st);
 
 // Resources
 #ifndef RES_IMAGES_FOLDER
 #define RES_IMAGES_FOLDER "/system/bootmenu/images"
 #endif
 
-// Returns 0 if no error, else negative.
+#ifndef RES_CACHE_FOLDER
+#define RES_CACHE_FOLDER "/cache/bootmenu"
+#endif
+
+// Returns 0 if no error, else negative. name.qoi is used if it exists,
+// else name.png. Surfaces are kept decoded in RES_CACHE_FOLDER (or
+// $MINUI_RES_CACHE), and loading the same file twice returns the same
+// surface.
+// Opaque images are converted to format (ordered dithering to RGB 565 if
+// dither is set, < 0 for the build default), others are 8888 with alpha
+// in its byte order.
+int res_create_surface_format(const char* name, gr_surface* pSurface,
+                              int format, int dither);
+// in gr_draw_format(), dithered unless BOARD_BOOTMENU_NO_DITHER
 int res_create_surface(const char* name, gr_surface* pSurface);
+// decodes a .png or .qoi file, without the cache, into a surface to
+// release with res_free_surface()
+int res_decode_surface(const char* path, int format, int dither, gr_surface* pSurface);
+// frees the surface once every res_create_surface*() of it is released
 void res_free_surface(gr_surface* pSurface);
 
+struct res_cache_stats {
+  unsigned hits;      // mapped from the cache
+  unsigned misses;    // decoded (and cached)
+  unsigned shared;    // already loaded
+};
+void res_get_cache_stats(struct res_cache_stats *st);
+// RES_CACHE_FOLDER or $MINUI_RES_CACHE, NULL if the cache is disabled
+const char *res_cache_folder(void);
+// While set, cache files are only written when it is cleared again, e.g.
+// when loading before /cache is mounted.
+void res_cache_defer(int defer);
+
 int gr_fb_test(void);
 
-#endif
+// Allocations linked in an arena, so what is still allocated is known and
+// can all be released at once, e.g. before exec'ing recovery.
+struct arena_block;
+struct arena {
+  const char *name;
+  pthread_mutex_t lock;
+  struct arena_block *blocks;
+  unsigned count;
+  size_t bytes;       // allocated and mapped
+  size_t peak;
+};
+#define ARENA_INIT(name) { name, PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, 0 }
+
+// surfaces, decoded fonts and glyphs, drawing buffers
+extern struct arena gr_arena;
+
+void *arena_alloc(struct arena *a, size_t size);
+// zeroed
+void *arena_calloc(struct arena *a, size_t size);
+void *arena_realloc(struct arena *a, void *p, size_t size);
+void arena_free(struct arena *a, void *p);
+// mmap() of fd counted in the arena, MAP_FAILED on error
+void *arena_mmap(struct arena *a, size_t len, int prot, int flags, int fd);
+void arena_unmap(struct arena *a, void *map);
+size_t arena_bytes(struct arena *a);
+// frees every block and mapping left, returns the bytes released
+size_t arena_release(struct arena *a);
 
 typedef struct {
   GGLSurface texture;
   unsigned cwidth;
   unsigned cheight;
   unsigned ascent;
+  // 96 glyphs of cheight rows, pitch bytes per row, msb first
+  unsigned char *glyphs;
+  unsigned pitch;
 } GRFont;
 
 struct CFont {
@@ -93,9 +244,18 @@ struct CFont {
   unsigned cwidth;
   unsigned cheight;
   unsigned cheightfix;
+  unsigned format;          // CFONT_*, RLE when left out
   unsigned char rundata[];
 };
 
+// rundata is a 0 terminated list of runs: count | 0x80 when set
+#define CFONT_RLE 0
+// rundata is the expanded width x height A8 texture, used in place
+#define CFONT_A8  1
+// rundata is 96 glyphs of cheight rows of (cwidth + 7) / 8 bytes,
+// leftmost pixel in the msb, used in place
+#define CFONT_1BPP 2
+
 struct UiFont {
   struct CFont *cfont;
   GRFont *gr_font;
@@ -107,9 +267,14 @@ struct UiFont {
 #define FONT_ITEM 1
 #define FONT_LOGS 2
 
+// decoded FONT_* font with its A8 texture, as gr_text() draws it, NULL if
+// out of memory. Owned by minui, valid until gr_exit().
+GRFont *gr_get_font(int slot);
+
 // Vibrator
 int vibrate(int timeout_ms);
 
 #define VIBRATOR_TIME_MS        22
 #define VIBRATOR_HARD_MS        32
 
+#endif
@@ -1,11 +1,53 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 typedef unsigned int  guint;
 typedef unsigned char guint8;
 
 #include "ExportedFont.h"
 
+/* -a: emit the expanded A8 texture (CFONT_A8), used in place by minui */
+static void dump_a8(void)
+{
+    unsigned n = gimp_image.width * gimp_image.height;
+    unsigned char *x = gimp_image.pixel_data;
+    unsigned i;
+
+    for (i = 0; i < n; i++, x += 3) {
+        printf("0x%02x,", *x ? 0x00 : 0xff);
+        if ((i % 15) == 14)
+            printf("\n");
+    }
+    printf("\n");
+}
+
+/* -b: emit packed 1bpp glyphs (CFONT_1BPP), 96 glyphs of cheight rows */
+static void dump_1bpp(void)
+{
+    unsigned cw = gimp_image.width / 96, ch = gimp_image.height;
+    unsigned pitch = (cw + 7) / 8;
+    unsigned g, y, b, n = 0;
+
+    for (g = 0; g < 96; g++) {
+        for (y = 0; y < ch; y++) {
+            for (b = 0; b < pitch; b++) {
+                unsigned char v = 0;
+                unsigned i;
+                for (i = 0; i < 8 && b * 8 + i < cw; i++) {
+                    unsigned x = g * cw + b * 8 + i;
+                    if (!gimp_image.pixel_data[(y * gimp_image.width + x) * 3])
+                        v |= 0x80 >> i;
+                }
+                printf("0x%02x,", v);
+                if ((++n % 15) == 0)
+                    printf("\n");
+            }
+        }
+    }
+    printf("\n");
+}
+
 int main(int argc, char **argv)
 {
     unsigned n;
@@ -13,6 +55,8 @@ int main(int argc, char **argv)
     unsigned m;
     unsigned run_val;
     unsigned run_count;
+    int a8 = (argc > 1 && !strcmp(argv[1], "-a"));
+    int packed = (argc > 1 && !strcmp(argv[1], "-b"));
 
     n = gimp_image.width * gimp_image.height;
     m = 0;
@@ -21,6 +65,20 @@ int main(int argc, char **argv)
     printf("struct CFont font = {\n");
     printf("  .width = %d,\n  .height = %d,\n  .cwidth = %d,\n  .cheight = %d,\n  .cheightfix = 0,\n", gimp_image.width, gimp_image.height,
            gimp_image.width / 96, gimp_image.height);
+    if (a8) {
+        printf("  .format = CFONT_A8,\n");
+        printf("  .rundata = {\n");
+        dump_a8();
+        printf("  }\n};\n");
+        return 0;
+    }
+    if (packed) {
+        printf("  .format = CFONT_1BPP,\n");
+        printf("  .rundata = {\n");
+        dump_1bpp();
+        printf("  }\n};\n");
+        return 0;
+    }
     printf("  .rundata = {\n");
 
     run_val = (*x ? 0 : 255);
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host tool converting the boot images to QOI, which minui decodes a lot
+ * faster than PNG. "mkqoi <name>.png..." writes <name>.qoi next to each
+ * PNG, after checking that it decodes back to the same pixels.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <png.h>
+
+#include "qoi.h"
+
+static unsigned char *read_png(const char *path, unsigned *w, unsigned *h,
+                               unsigned *channels)
+{
+    png_structp png;
+    png_infop info;
+    unsigned char *rgba = NULL;
+    unsigned char **rows = NULL;
+    unsigned y;
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL)
+        return NULL;
+    png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    info = png ? png_create_info_struct(png) : NULL;
+    if (info == NULL || setjmp(png_jmpbuf(png))) {
+        free(rgba);
+        free(rows);
+        png_destroy_read_struct(&png, &info, NULL);
+        fclose(fp);
+        return NULL;
+    }
+    png_init_io(png, fp);
+    png_read_info(png, info);
+
+    // everything to 8 bit RGBA, keeping track of real transparency
+    *channels = (png_get_color_type(png, info) & PNG_COLOR_MASK_ALPHA) ||
+                png_get_valid(png, info, PNG_INFO_tRNS) ? 4 : 3;
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_gray_to_rgb(png);
+    png_set_filler(png, 0xff, PNG_FILLER_AFTER);
+    png_read_update_info(png, info);
+
+    *w = png_get_image_width(png, info);
+    *h = png_get_image_height(png, info);
+    rgba = malloc(*w * *h * 4);
+    rows = malloc(*h * sizeof(*rows));
+    if (rgba == NULL || rows == NULL)
+        png_error(png, "out of memory");
+    for (y = 0; y < *h; y++)
+        rows[y] = rgba + y * *w * 4;
+    png_read_image(png, rows);
+    png_read_end(png, NULL);
+
+    free(rows);
+    png_destroy_read_struct(&png, &info, NULL);
+    fclose(fp);
+    return rgba;
+}
+
+static void put32(unsigned char *p, unsigned v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+// returns the encoded size, out must hold w * h * 5 + header and padding
+static size_t encode(const unsigned char *rgba, unsigned w, unsigned h,
+                     unsigned channels, unsigned char *out)
+{
+    unsigned char index[64][4];
+    unsigned char prev[4] = { 0, 0, 0, 255 };
+    unsigned char *p = out;
+    unsigned i, n = w * h;
+    int run = 0;
+
+    memset(index, 0, sizeof(index));
+    memcpy(p, "qoif", 4);
+    put32(p + 4, w);
+    put32(p + 8, h);
+    p[12] = channels;
+    p[13] = 0;  // sRGB
+    p += QOI_HEADER_SIZE;
+
+    for (i = 0; i < n; i++) {
+        const unsigned char *px = rgba + i * 4;
+
+        if (!memcmp(px, prev, 4)) {
+            if (++run == 62 || i == n - 1) {
+                *p++ = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            *p++ = QOI_OP_RUN | (run - 1);
+            run = 0;
+        }
+
+        int hash = QOI_HASH(px[0], px[1], px[2], px[3]);
+        if (!memcmp(index[hash], px, 4)) {
+            *p++ = QOI_OP_INDEX | hash;
+        } else {
+            memcpy(index[hash], px, 4);
+            if (px[3] == prev[3]) {
+                signed char dr = px[0] - prev[0];
+                signed char dg = px[1] - prev[1];
+                signed char db = px[2] - prev[2];
+                signed char dr_dg = dr - dg;
+                signed char db_dg = db - dg;
+
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                    *p++ = QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+                } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 &&
+                           db_dg >= -8 && db_dg <= 7) {
+                    *p++ = QOI_OP_LUMA | (dg + 32);
+                    *p++ = (dr_dg + 8) << 4 | (db_dg + 8);
+                } else {
+                    *p++ = QOI_OP_RGB;
+                    *p++ = px[0];
+                    *p++ = px[1];
+                    *p++ = px[2];
+                }
+            } else {
+                *p++ = QOI_OP_RGBA;
+                memcpy(p, px, 4);
+                p += 4;
+            }
+        }
+        memcpy(prev, px, 4);
+    }
+
+    memset(p, 0, QOI_PADDING - 1);
+    p[QOI_PADDING - 1] = 1;
+    return p + QOI_PADDING - out;
+}
+
+static int convert(const char *in)
+{
+    unsigned w, h, channels, dw, dh, dc;
+    unsigned char *rgba, *qoi, *check;
+    char out[1024];
+    size_t len, size;
+    const char *ext = strrchr(in, '.');
+    FILE *fp;
+    int ok;
+
+    len = (ext && !strcmp(ext, ".png")) ? (size_t) (ext - in) : strlen(in);
+    if (len + 5 > sizeof(out)) {
+        fprintf(stderr, "mkqoi: %s: name too long\n", in);
+        return -1;
+    }
+    memcpy(out, in, len);
+    strcpy(out + len, ".qoi");
+
+    rgba = read_png(in, &w, &h, &channels);
+    if (rgba == NULL || w > QOI_MAX_SIZE || h > QOI_MAX_SIZE) {
+        fprintf(stderr, "mkqoi: %s: can't read PNG\n", in);
+        free(rgba);
+        return -1;
+    }
+    qoi = malloc((size_t) w * h * 5 + QOI_HEADER_SIZE + QOI_PADDING);
+    check = malloc((size_t) w * h * 4);
+    size = encode(rgba, w, h, channels, qoi);
+
+    ok = !qoi_header(qoi, size, &dw, &dh, &dc) && dw == w && dh == h &&
+         !qoi_decode(qoi, size, check, w) && !memcmp(check, rgba, (size_t) w * h * 4);
+    if (!ok) {
+        fprintf(stderr, "mkqoi: %s: round trip failed\n", in);
+    } else if ((fp = fopen(out, "wb")) == NULL || fwrite(qoi, 1, size, fp) != size ||
+               fclose(fp) != 0) {
+        fprintf(stderr, "mkqoi: can't write %s\n", out);
+        ok = 0;
+    } else {
+        printf("%s: %ux%u, %u channels, %zu bytes\n", out, w, h, channels, size);
+    }
+
+    free(check);
+    free(qoi);
+    free(rgba);
+    return ok ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, rc = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: mkqoi image.png...\n");
+        return 1;
+    }
+    for (i = 1; i < argc; i++) {
+        if (convert(argv[i]) < 0)
+            rc = 1;
+    }
+    return rc;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "qoi.h"
+
+static unsigned qoi_read32(const unsigned char *p)
+{
+    return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+int qoi_header(const unsigned char *data, size_t size,
+               unsigned *width, unsigned *height, unsigned *channels)
+{
+    if (size < QOI_HEADER_SIZE + QOI_PADDING || memcmp(data, "qoif", 4))
+        return -1;
+    *width = qoi_read32(data + 4);
+    *height = qoi_read32(data + 8);
+    *channels = data[12];
+    if (*width == 0 || *height == 0 || *width > QOI_MAX_SIZE ||
+        *height > QOI_MAX_SIZE || (*channels != 3 && *channels != 4))
+        return -1;
+    return 0;
+}
+
+int qoi_decode(const unsigned char *data, size_t size,
+               unsigned char *rgba, unsigned stride)
+{
+    unsigned char index[64][4];
+    unsigned char px[4] = { 0, 0, 0, 255 };
+    unsigned width, height, channels, x, y;
+    const unsigned char *p, *end;
+    int run = 0;
+
+    if (qoi_header(data, size, &width, &height, &channels) < 0)
+        return -1;
+    memset(index, 0, sizeof(index));
+    p = data + QOI_HEADER_SIZE;
+    // every op is at most 5 bytes, the padding keeps reads in bounds
+    end = data + size - QOI_PADDING;
+
+    for (y = 0; y < height; y++) {
+        unsigned char *d = rgba + y * stride * 4;
+        for (x = 0; x < width; x++, d += 4) {
+            if (run > 0) {
+                run--;
+            } else {
+                int op;
+                if (p >= end)
+                    return -1;
+                op = *p++;
+                if (op == QOI_OP_RGB) {
+                    px[0] = p[0];
+                    px[1] = p[1];
+                    px[2] = p[2];
+                    p += 3;
+                } else if (op == QOI_OP_RGBA) {
+                    px[0] = p[0];
+                    px[1] = p[1];
+                    px[2] = p[2];
+                    px[3] = p[3];
+                    p += 4;
+                } else if ((op & QOI_MASK_2) == QOI_OP_INDEX) {
+                    memcpy(px, index[op], 4);
+                } else if ((op & QOI_MASK_2) == QOI_OP_DIFF) {
+                    px[0] += ((op >> 4) & 3) - 2;
+                    px[1] += ((op >> 2) & 3) - 2;
+                    px[2] += (op & 3) - 2;
+                } else if ((op & QOI_MASK_2) == QOI_OP_LUMA) {
+                    int dg = (op & 0x3f) - 32;
+                    int b2 = *p++;
+                    px[0] += dg - 8 + ((b2 >> 4) & 0x0f);
+                    px[1] += dg;
+                    px[2] += dg - 8 + (b2 & 0x0f);
+                } else {
+                    run = op & 0x3f;
+                }
+                memcpy(index[QOI_HASH(px[0], px[1], px[2], px[3])], px, 4);
+            }
+            memcpy(d, px, 4);
+        }
+    }
+    return 0;
+}
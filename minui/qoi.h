@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _MINUI_QOI_H_
+#define _MINUI_QOI_H_
+
+#include <stddef.h>
+
+/*
+ * "Quite OK Image" lossless format (https://qoiformat.org), decoded in one
+ * pass without tables or inflate, a lot faster than PNG. Boot images are
+ * converted with mkqoi on the host and looked up before the .png.
+ */
+#define QOI_HEADER_SIZE 14
+#define QOI_MAX_SIZE    8192
+
+// returns 0 if data starts with a valid header; channels is 3 or 4
+int qoi_header(const unsigned char *data, size_t size,
+               unsigned *width, unsigned *height, unsigned *channels);
+
+// decodes all pixels as RGBA, stride in pixels; returns 0, or -1 if the
+// data ends too early
+int qoi_decode(const unsigned char *data, size_t size,
+               unsigned char *rgba, unsigned stride);
+
+// op codes and hash, shared with the mkqoi encoder
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+#define QOI_OP_RGBA  0xff
+#define QOI_MASK_2   0xc0
+#define QOI_HASH(r, g, b, a) (((r) * 3 + (g) * 5 + (b) * 7 + (a) * 11) & 63)
+// 7 zero bytes and a 1 end the stream
+#define QOI_PADDING  8
+
+#endif
@@ -18,16 +18,23 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <linux/fb.h>
 #include <linux/kd.h>
 #include <pixelflinger/pixelflinger.h>
+#ifndef BOARD_BOOTMENU_NO_PNG
 #include <png.h>
+#endif
 
 #include "minui.h"
+#include "qoi.h"
 
+#ifndef BOARD_BOOTMENU_NO_PNG
 // libpng gives "undefined reference to 'pow'" errors, and I have no
 // idea how to convince the build system to link with -lm.  We don't
 // need this functionality (it's used for gamma adjustment) so provide
@@ -35,17 +42,301 @@
 double pow(double x, double y) {
     return x;
 }
+#endif
 
-int res_create_surface(const char* name, gr_surface* pSurface) {
-    char resPath[256];
+// Decoded surfaces are saved in the cache folder already converted, and
+// mapped back at the next start instead of being decoded again. A cache
+// file is only used if it was made for the same target format and dither
+// from a source of the same path, size and mtime.
+#define RES_CACHE_MAGIC   0x43534d42 /* "BMSC" */
+#define RES_CACHE_VERSION 2
+
+struct res_cache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t target;        // format asked for
+    uint32_t dither;
+    uint32_t format;        // GGL_PIXEL_FORMAT_* of the pixels
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;        // in pixels
+    uint32_t bpp;
+    uint32_t reserved;
+    int64_t src_size;
+    int64_t src_mtime;
+    char src_path[256];
+};  // followed by height * stride * bpp bytes of pixels
+
+// surfaces already loaded, returned again for the same source file
+// and conversion, until res_free_surface() released them all
+#define RES_SHARED_MAX 16
+static struct {
+    int format;
+    int dither;
+    struct stat st;
+    GGLSurface *surface;
+    int refs;
+    // not in the cache yet, see res_cache_defer
+    int pending;
+    char name[64];
+    char path[256];
+} res_shared[RES_SHARED_MAX];
+static int res_shared_count = 0;
+static int res_cache_deferred = 0;
+
+static struct res_cache_stats res_stats;
+
+static GGLSurface *res_shared_find(const struct stat *st, int format, int dither) {
+    int i;
+    for (i = 0; i < res_shared_count; i++) {
+        const struct stat *s = &res_shared[i].st;
+        if (res_shared[i].format == format && res_shared[i].dither == dither &&
+            s->st_dev == st->st_dev && s->st_ino == st->st_ino &&
+            s->st_size == st->st_size && s->st_mtime == st->st_mtime) {
+            res_shared[i].refs++;
+            return res_shared[i].surface;
+        }
+    }
+    return NULL;
+}
+
+static void res_shared_add(const char *name, const char *resPath, const struct stat *st,
+                           int format, int dither, GGLSurface *surface, int pending) {
+    if (res_shared_count >= RES_SHARED_MAX)
+        return;
+    res_shared[res_shared_count].format = format;
+    res_shared[res_shared_count].dither = dither;
+    res_shared[res_shared_count].st = *st;
+    res_shared[res_shared_count].surface = surface;
+    res_shared[res_shared_count].refs = 1;
+    res_shared[res_shared_count].pending = pending;
+    strncpy(res_shared[res_shared_count].name, name, sizeof(res_shared[0].name) - 1);
+    strncpy(res_shared[res_shared_count].path, resPath, sizeof(res_shared[0].path) - 1);
+    res_shared_count++;
+}
+
+// $MINUI_RES_CACHE overrides RES_CACHE_FOLDER, empty disables the cache
+const char *res_cache_folder(void) {
+    const char *dir = getenv("MINUI_RES_CACHE");
+    if (dir == NULL)
+        dir = RES_CACHE_FOLDER;
+    return *dir ? dir : NULL;
+}
+
+static int res_bpp(int format) {
+    return format == GGL_PIXEL_FORMAT_RGB_565 ? 2 : 4;
+}
+
+static int res_cache_matches(const struct res_cache_header *h, size_t size,
+                             const char *resPath, const struct stat *st,
+                             int format, int dither) {
+    return h->magic == RES_CACHE_MAGIC && h->version == RES_CACHE_VERSION &&
+           h->target == (uint32_t) format && h->dither == (uint32_t) dither &&
+           h->bpp == (uint32_t) res_bpp(h->format) &&
+           h->src_size == (int64_t) st->st_size &&
+           h->src_mtime == (int64_t) st->st_mtime &&
+           !strncmp(h->src_path, resPath, sizeof(h->src_path)) &&
+           h->stride >= h->width &&
+           size == sizeof(*h) + (size_t) h->stride * h->height * h->bpp;
+}
+
+// one mmap of the whole file, the pixels are used in place
+static GGLSurface *res_cache_load(const char *cachePath, const char *resPath,
+                                  const struct stat *st, int format, int dither) {
+    GGLSurface *surface;
+    struct stat cst;
+    void *map;
+    int fd;
+
+    fd = open(cachePath, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &cst) < 0 || cst.st_size < (off_t) sizeof(struct res_cache_header)) {
+        close(fd);
+        return NULL;
+    }
+    // private and writable so a stray write can't reach the file
+    map = arena_mmap(&gr_arena, cst.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    const struct res_cache_header *h = map;
+    if (!res_cache_matches(h, cst.st_size, resPath, st, format, dither) ||
+        (surface = arena_alloc(&gr_arena, sizeof(GGLSurface))) == NULL) {
+        arena_unmap(&gr_arena, map);
+        return NULL;
+    }
+    surface->version = sizeof(GGLSurface);
+    surface->width = h->width;
+    surface->height = h->height;
+    surface->stride = h->stride;
+    surface->format = h->format;
+    surface->data = (GGLubyte *) map + sizeof(*h);
+    return surface;
+}
+
+static void res_cache_store(const char *dir, const char *cachePath,
+                            const char *resPath, const struct stat *st,
+                            int format, int dither, const GGLSurface *surface) {
+    struct res_cache_header h;
+    char tmpPath[256];
+    size_t bytes;
+    int fd, ok;
+
+    memset(&h, 0, sizeof(h));
+    h.magic = RES_CACHE_MAGIC;
+    h.version = RES_CACHE_VERSION;
+    h.target = format;
+    h.dither = dither;
+    h.format = surface->format;
+    h.width = surface->width;
+    h.height = surface->height;
+    h.stride = surface->stride;
+    h.bpp = res_bpp(surface->format);
+    h.src_size = st->st_size;
+    h.src_mtime = st->st_mtime;
+    strncpy(h.src_path, resPath, sizeof(h.src_path) - 1);
+    bytes = (size_t) h.stride * h.height * h.bpp;
+
+    mkdir(dir, 0755);
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", cachePath);
+    fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return;
+    ok = write(fd, &h, sizeof(h)) == (ssize_t) sizeof(h) &&
+         write(fd, surface->data, bytes) == (ssize_t) bytes;
+    ok = (close(fd) == 0) && ok;
+    // rename so a partial file never has the final name
+    if (!ok || rename(tmpPath, cachePath) < 0)
+        unlink(tmpPath);
+}
+
+// 4x4 Bayer matrix, thresholds 0 .. 15
+static const unsigned char res_bayer[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 },
+};
+
+/* RGBA rows to RGB 565 in place. With dither, a threshold below one step
+ * of the channel is added before truncating: colors the panel can show
+ * exactly stay flat, and gradients don't band. */
+static void res_pack_565(GGLSurface *s, int dither) {
+    unsigned x, y;
+
+    for (y = 0; y < s->height; y++) {
+        const unsigned char *p = s->data + y * s->stride * 4;
+        uint16_t *d = (uint16_t*) s->data + y * s->stride;
+        for (x = 0; x < s->width; x++, p += 4) {
+            unsigned t = dither ? res_bayer[y & 3][x & 3] : 0;
+            unsigned r = p[0] + (t >> 1);
+            unsigned g = p[1] + (t >> 2);
+            unsigned b = p[2] + (t >> 1);
+            if (r > 0xff) r = 0xff;
+            if (g > 0xff) g = 0xff;
+            if (b > 0xff) b = 0xff;
+            d[x] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+        }
+    }
+}
+
+/* Decoded RGBA pixels to what blits to a format surface fastest: the same
+ * format when the image is opaque, else 8888 with alpha in its byte order.
+ * Returns the surface, moved if it was shrunk. */
+static GGLSurface *res_convert(GGLSurface *s, int format, int opaque, int dither) {
+    GGLSurface *shrunk;
+    unsigned i, n = s->stride * s->height;
+
+    if (format == GGL_PIXEL_FORMAT_RGB_565 && opaque) {
+        res_pack_565(s, dither);
+        s->format = GGL_PIXEL_FORMAT_RGB_565;
+        shrunk = arena_realloc(&gr_arena, s, sizeof(GGLSurface) + n * 2);
+        if (shrunk) {
+            shrunk->data = (GGLubyte*) (shrunk + 1);
+            s = shrunk;
+        }
+        return s;
+    }
+
+    if (format == GGL_PIXEL_FORMAT_BGRA_8888) {
+        for (i = 0; i < n; i++) {
+            unsigned char r = s->data[i * 4];
+            s->data[i * 4] = s->data[i * 4 + 2];
+            s->data[i * 4 + 2] = r;
+        }
+        s->format = GGL_PIXEL_FORMAT_BGRA_8888;
+    } else {
+        s->format = opaque ? GGL_PIXEL_FORMAT_RGBX_8888 : GGL_PIXEL_FORMAT_RGBA_8888;
+    }
+    return s;
+}
+
+static int res_decode_qoi(const char* resPath, int format, int dither,
+                          GGLSurface** pSurface) {
+    GGLSurface* surface;
+    unsigned width, height, channels;
+    struct stat st;
+    void *map;
+    int result = 0;
+
+    int fd = open(resPath, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || st.st_size < QOI_HEADER_SIZE) {
+        close(fd);
+        return -2;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -2;
+
+    if (qoi_header(map, st.st_size, &width, &height, &channels) < 0) {
+        result = -3;
+        goto exit;
+    }
+    surface = arena_alloc(&gr_arena, sizeof(GGLSurface) + width * height * 4);
+    if (surface == NULL) {
+        result = -8;
+        goto exit;
+    }
+    surface->version = sizeof(GGLSurface);
+    surface->width = width;
+    surface->height = height;
+    surface->stride = width;
+    surface->data = (GGLubyte*) (surface + 1);
+    if (qoi_decode(map, st.st_size, surface->data, width) < 0) {
+        arena_free(&gr_arena, surface);
+        result = -6;
+        goto exit;
+    }
+
+    unsigned i, opaque = 1;
+    for (i = 0; channels == 4 && i < width * height; i++)
+        opaque &= (surface->data[i * 4 + 3] == 0xff);
+    *pSurface = res_convert(surface, format, opaque, dither);
+
+exit:
+    munmap(map, st.st_size);
+    return result;
+}
+
+#ifdef BOARD_BOOTMENU_NO_PNG
+static int res_decode_png(const char* resPath, int format, int dither,
+                          GGLSurface** pSurface) {
+    return -3;
+}
+#else
+static int res_decode_png(const char* resPath, int format, int dither,
+                          GGLSurface** pSurface) {
     GGLSurface* surface = NULL;
     int result = 0;
     unsigned char header[8];
     png_structp png_ptr = NULL;
     png_infop info_ptr = NULL;
 
-    snprintf(resPath, sizeof(resPath)-1, RES_IMAGES_FOLDER "/%s.png", name);
-    resPath[sizeof(resPath)-1] = '\0';
     FILE* fp = fopen(resPath, "rb");
     if (fp == NULL) {
         result = -1;
@@ -96,11 +387,18 @@ int res_create_surface(const char* name, gr_surface* pSurface) {
           ((channels == 3 && color_type == PNG_COLOR_TYPE_RGB) ||
            (channels == 4 && color_type == PNG_COLOR_TYPE_RGBA) ||
            (channels == 1 && color_type == PNG_COLOR_TYPE_PALETTE)))) {
-        return -7;
+        result = -7;
         goto exit;
     }
 
-    surface = malloc(sizeof(GGLSurface) + pixelSize);
+    if (color_type == PNG_COLOR_TYPE_PALETTE) {
+        png_set_palette_to_rgb(png_ptr);
+    }
+    // 3 channels, or 4 for palettes with transparency
+    png_read_update_info(png_ptr, info_ptr);
+    channels = info_ptr->channels;
+
+    surface = arena_alloc(&gr_arena, sizeof(GGLSurface) + pixelSize);
     if (surface == NULL) {
         result = -8;
         goto exit;
@@ -111,64 +409,31 @@ int res_create_surface(const char* name, gr_surface* pSurface) {
     surface->height = height;
     surface->stride = width; /* Yes, pixels, not bytes */
     surface->data = pData;
-    if (channels == 3)
-        surface->format = GGL_PIXEL_FORMAT_RGBX_8888;
-    else
-#ifndef PIXELS_BGRA
-        surface->format = GGL_PIXEL_FORMAT_RGBA_8888;
-#else
-        surface->format = GGL_PIXEL_FORMAT_BGRA_8888;
-#endif
-
-    if (color_type == PNG_COLOR_TYPE_PALETTE) {
-        png_set_palette_to_rgb(png_ptr);
-    }
 
     int x;
     size_t y;
-    if (channels == 3) {
-        for (y = 0; y < height; ++y) {
-            unsigned char* pRow = pData + y * stride;
-            png_read_row(png_ptr, pRow, NULL);
+    int opaque = 1;
+    for (y = 0; y < height; ++y) {
+        unsigned char* pRow = pData + y * stride;
+        png_read_row(png_ptr, pRow, NULL);
 
+        if (channels == 3) {
             for(x = width - 1; x >= 0; x--) {
                 int sx = x * 3;
                 int dx = x * 4;
-                unsigned char r = pRow[sx];
-                unsigned char g = pRow[sx + 1];
-                unsigned char b = pRow[sx + 2];
-                unsigned char a = 0xff;
-#ifndef PIXELS_BGRA
-                pRow[dx    ] = r; // r
-                pRow[dx + 1] = g; // g
-                pRow[dx + 2] = b; // b
-                pRow[dx + 3] = a;
-#else
-                pRow[dx + 2] = r;
-                pRow[dx + 1] = g;
-                pRow[dx    ] = b;
-                pRow[dx + 3] = a;
-#endif
-            }
-        }
-    } else {
-        for (y = 0; y < height; ++y) {
-            unsigned char* pRow = pData + y * stride;
-            png_read_row(png_ptr, pRow, NULL);
-#ifdef PIXELS_BGRA
-            if (channels == 4) {
-              for (x = width - 1; x >= 0; x--) {
-                 int dx = x * 4;
-                 unsigned char r = pRow[dx];
-                 pRow[dx] = pRow[dx + 2];
-                 pRow[dx + 2] = r;
-              }
+                pRow[dx + 3] = 0xff;
+                pRow[dx + 2] = pRow[sx + 2]; // b
+                pRow[dx + 1] = pRow[sx + 1]; // g
+                pRow[dx    ] = pRow[sx];     // r
             }
-#endif
+        } else {
+            for (x = 0; x < (int) width; x++)
+                opaque &= (pRow[x * 4 + 3] == 0xff);
         }
     }
 
-    *pSurface = (gr_surface) surface;
+    surface = res_convert(surface, format, opaque, dither);
+    *pSurface = surface;
 
 exit:
     png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
@@ -177,13 +442,123 @@ exit:
         fclose(fp);
     }
     if (result < 0 && surface) {
-        free(surface);
+        arena_free(&gr_arena, surface);
     }
     return result;
 }
+#endif
+
+int res_decode_surface(const char* path, int format, int dither, gr_surface* pSurface) {
+    const char *ext = strrchr(path, '.');
+    GGLSurface *surface = NULL;
+    int result;
+
+    dither = (dither && format == GGL_PIXEL_FORMAT_RGB_565);
+    if (ext && !strcmp(ext, ".qoi"))
+        result = res_decode_qoi(path, format, dither, &surface);
+    else
+        result = res_decode_png(path, format, dither, &surface);
+    if (result == 0)
+        *pSurface = (gr_surface) surface;
+    return result;
+}
+
+int res_create_surface_format(const char* name, gr_surface* pSurface,
+                              int format, int dither) {
+    char resPath[256];
+    char cachePath[256];
+    const char *dir = res_cache_folder();
+    GGLSurface* surface = NULL;
+    struct stat st;
+    int result, pending = 0;
+
+    // a .qoi made by mkqoi is preferred, it decodes much faster
+    snprintf(resPath, sizeof(resPath)-1, RES_IMAGES_FOLDER "/%s.qoi", name);
+    resPath[sizeof(resPath)-1] = '\0';
+    if (stat(resPath, &st) < 0) {
+        snprintf(resPath, sizeof(resPath)-1, RES_IMAGES_FOLDER "/%s.png", name);
+        resPath[sizeof(resPath)-1] = '\0';
+        if (stat(resPath, &st) < 0)
+            return -1;
+    }
+
+    if (dither < 0) {
+#ifdef BOARD_BOOTMENU_NO_DITHER
+        dither = 0;
+#else
+        dither = 1;
+#endif
+    }
+    dither = (dither && format == GGL_PIXEL_FORMAT_RGB_565);
+    surface = res_shared_find(&st, format, dither);
+    if (surface) {
+        res_stats.shared++;
+        *pSurface = (gr_surface) surface;
+        return 0;
+    }
+
+    if (dir) {
+        snprintf(cachePath, sizeof(cachePath), "%s/%s.surf", dir, name);
+        surface = res_cache_load(cachePath, resPath, &st, format, dither);
+    }
+    if (surface) {
+        res_stats.hits++;
+    } else {
+        result = res_decode_surface(resPath, format, dither, pSurface);
+        if (result < 0)
+            return result;
+        surface = *pSurface;
+        res_stats.misses++;
+        if (dir && res_cache_deferred)
+            pending = 1;
+        else if (dir)
+            res_cache_store(dir, cachePath, resPath, &st, format, dither, surface);
+    }
+
+    res_shared_add(name, resPath, &st, format, dither, surface, pending);
+    *pSurface = (gr_surface) surface;
+    return 0;
+}
+
+int res_create_surface(const char* name, gr_surface* pSurface) {
+    return res_create_surface_format(name, pSurface, gr_draw_format(), -1);
+}
+
+void res_cache_defer(int defer) {
+    const char *dir = res_cache_folder();
+    char cachePath[256];
+    int i;
+
+    res_cache_deferred = defer;
+    if (defer)
+        return;
+    for (i = 0; i < res_shared_count; i++) {
+        if (!res_shared[i].pending)
+            continue;
+        res_shared[i].pending = 0;
+        if (dir == NULL)
+            continue;
+        snprintf(cachePath, sizeof(cachePath), "%s/%s.surf", dir, res_shared[i].name);
+        res_cache_store(dir, cachePath, res_shared[i].path, &res_shared[i].st,
+                        res_shared[i].format, res_shared[i].dither, res_shared[i].surface);
+    }
+}
+
+void res_get_cache_stats(struct res_cache_stats *st) {
+    *st = res_stats;
+}
+
+// pixels of surfaces mapped from the cache follow the file's header
+static void res_release(GGLSurface *surface) {
+    if (surface->data != (GGLubyte*) (surface + 1))
+        arena_unmap(&gr_arena, surface->data - sizeof(struct res_cache_header));
+    arena_free(&gr_arena, surface);
+}
 
 void res_free_surface(gr_surface* pSurface) {
     GGLSurface* surface;
+    int i;
+
     if (pSurface && *pSurface) {
         surface = *pSurface;
 
@@ -197,10 +572,19 @@ void res_free_surface(gr_surface* pSurface) {
         //ui_print("pSurface ptr     = %x\n", (unsigned) pSurface);
 #endif
 
-        //doesnt works :(
-        //free(surface);
+        for (i = 0; i < res_shared_count; i++) {
+            if (res_shared[i].surface == surface)
+                break;
+        }
+        if (i == res_shared_count) {
+            // from res_decode_surface(), or the table was full
+            res_release(surface);
+        } else if (--res_shared[i].refs == 0) {
+            // a deferred cache write is dropped, it is decoded next time
+            res_release(surface);
+            res_shared[i] = res_shared[--res_shared_count];
+        }
 
         *pSurface=NULL;
     }
 }
-
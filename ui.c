@@ -32,6 +32,7 @@
 #include "minui/minui.h"
 #include "bootmenu_ui.h"
 #include "extendedcommands.h"
+#include "key_queue.h"
 
 #ifndef MAX_ROWS
 #define MAX_COLS 96
@@ -109,12 +110,11 @@ static int menu_items = 0, menu_sel = 0;
 static int menu_show_start = 0;             // this is line which menu display is starting at
 static char menu_headers[MAX_ROWS][MAX_COLS];
 static int menu_header_lines = 0;
+static char** menu_source = NULL;           // headers given to ui_start_menu()
+// frames of this menu are saved as the next start's splash
+static char** splash_menu = NULL;
+static int splash_drawn = 0;
 
-// Key event input queue
-static pthread_mutex_t key_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t key_queue_cond = PTHREAD_COND_INITIALIZER;
-static struct ui_input_event key_queue[256];
-static int key_queue_len = 0;
 static volatile char key_pressed[KEY_MAX + 1];
 static int evt_enabled = 0;
 
@@ -224,7 +224,8 @@ static int get_menuitem_height(int item) {
   return 0;
 }
 
-static int draw_menu_item(int top, int item) {
+// clip_top and clip_bottom are the list viewport
+static int draw_menu_item(int top, int item, int clip_top, int clip_bottom) {
   int height=get_menuitem_height(item);
   struct UiColor color_text;
   struct UiColor color_background;
@@ -259,18 +260,18 @@ static int draw_menu_item(int top, int item) {
       int draw_bottom_line=1;
 
       // don't draw if item is outside of list's viewport
-      if(bgtop+height>=square_inner_top && bgbottom<=square_inner_bottom+height) {
+      if(bgtop+height>=clip_top && bgbottom<=clip_bottom+height) {
 
         // cut background at square's top side
-        if(bgtop<square_inner_top) {
-          bgheight-= square_inner_top-bgtop;
-          bgtop = square_inner_top;
+        if(bgtop<clip_top) {
+          bgheight-= clip_top-bgtop;
+          bgtop = clip_top;
         }
 
         // cut background and text at sqaure's bottom side
-        if(bgbottom>square_inner_bottom) {
-          bgheight-=bgbottom-square_inner_bottom;
-          bgbottom=square_inner_bottom;
+        if(bgbottom>clip_bottom) {
+          bgheight-=bgbottom-clip_bottom;
+          bgbottom=clip_bottom;
           draw_bottom_line=0;
         }
 
@@ -282,7 +283,7 @@ static int draw_menu_item(int top, int item) {
         gr_setfont(FONT_ITEM);
         gr_set_uicolor(color_text);
         gr_text_cut(square_inner_left, top+height-height/2+gr_getfont_cheight()/2-gr_getfont_cheightfix(), menu[item].title,
-                    square_inner_left, square_inner_right, square_inner_top, bgbottom);
+                    square_inner_left, square_inner_right, clip_top, bgbottom);
 
         // draw bottom_line
         if(draw_bottom_line==1) {
@@ -329,105 +330,418 @@ static int ui_get_menu_height() {
   return height;
 }
 
-// Redraw everything on the screen.  Does not flip pages.
-// Should only be called with gUpdateMutex locked.
-static void draw_screen_locked(void)
+/*
+ * Retained layers: the status bar, tab bar, menu list and log pane are
+ * rendered into offscreen surfaces and only re-rendered when the state
+ * they show changes, frames are composited from them with blits.
+ */
+#define LAYER_MAX_INPUTS 8
+#define LAYER_MENU_MAX_BYTES (4 * 1024 * 1024)
+
+struct ui_layer {
+  const char *name;
+  gr_surface surface;
+  int width, height, alpha;
+  intptr_t inputs[LAYER_MAX_INPUTS]; // state of the last rendering
+  unsigned renders;                  // since the last report
+};
+
+enum { LAYER_STATUS, LAYER_TABS, LAYER_MENU, LAYER_LOG, LAYER_COUNT };
+
+static struct ui_layer layers[LAYER_COUNT] = {
+  [LAYER_STATUS] = { .name = "status" },
+  [LAYER_TABS] = { .name = "tabs" },
+  [LAYER_MENU] = { .name = "menu" },
+  [LAYER_LOG] = { .name = "log" },
+};
+static time_t layers_report_time = 0;
+
+// bumped on each change of the log text
+static unsigned text_serial = 0;
+
+// status bar values, sampled once per second
+static char status_time[16], status_usb[16];
+static int status_battery = 0;
+static time_t status_time_sampled = 0;
+
+static unsigned hash_str(unsigned h, const char *s)
 {
-  if (show_menu != 1) return;
+  while (s && *s) h = h * 33 + (unsigned char) *s++;
+  return h;
+}
+
+/* Make sure the layer is w x h and up to date with inputs. Returns 1 with
+ * the layer set as target at screen position (x, y) if the caller has to
+ * render it (and then call gr_set_target(NULL, 0, 0)), 0 if it is up to
+ * date, and -1 if there is no memory for it (draw directly then). */
+static int layer_begin(struct ui_layer *l, int x, int y, int w, int h, int alpha,
+                       const intptr_t *inputs)
+{
+  if (l->surface && (l->width != w || l->height != h || l->alpha != alpha)) {
+    gr_free_surface(l->surface);
+    l->surface = NULL;
+  }
+  if (l->surface == NULL) {
+    l->surface = gr_create_surface(w, h, alpha);
+    if (l->surface == NULL)
+      return -1;
+    l->width = w;
+    l->height = h;
+    l->alpha = alpha;
+  } else if (!memcmp(l->inputs, inputs, sizeof(l->inputs))) {
+    return 0;
+  }
 
+  memcpy(l->inputs, inputs, sizeof(l->inputs));
+  l->renders++;
+  gr_set_target(l->surface, x, y);
+  return 1;
+}
+
+static void layer_end(void)
+{
+  gr_set_target(NULL, 0, 0);
+}
+
+static void layers_free(void)
+{
   int i;
-  int marginTop = ui_get_menu_top();
-  struct timeval bouncediff, tvNow;
-  gettimeofday(&tvNow, NULL);
+  for (i = 0; i < LAYER_COUNT; i++) {
+    if (layers[i].surface) gr_free_surface(layers[i].surface);
+    layers[i].surface = NULL;
+  }
+}
 
+// log the layer re-renders of the last second, if any
+static void layers_report(void)
+{
+  time_t now = time(NULL);
+  unsigned total = 0;
+  int i;
 
-  if (enable_bounceback == 1) {
-    timeval_subtract(&bouncediff, &tvNow, &bounceback_start_time);
-    int t0 = BOUNCEBACK_TIME*1000;
-    int t1 = t0- (bouncediff.tv_sec*1000000+bouncediff.tv_usec);
-    int way = abs(bounceback_start-bounceback_targetpos);
-    //int pway = round((double)way/t0*t1);
-    int pway = way/t0*t1;
+  if (now == layers_report_time) return;
 
-    if(pway<=0) {
-      enable_bounceback=0;
-      menutop_diff=bounceback_targetpos;
+  for (i = 0; i < LAYER_COUNT; i++) total += layers[i].renders;
+  if (total && layers_report_time) {
+    fprintf(stdout, "layers: %s %u, %s %u, %s %u, %s %u re-renders in %lds\n",
+            layers[0].name, layers[0].renders, layers[1].name, layers[1].renders,
+            layers[2].name, layers[2].renders, layers[3].name, layers[3].renders,
+            (long) (now - layers_report_time));
+  }
+  for (i = 0; i < LAYER_COUNT; i++) layers[i].renders = 0;
+  layers_report_time = now;
+}
+
+// log the input reading cost every 10s of input, see ev_get_stats()
+static void input_report(void)
+{
+  static struct ev_stats last;
+  static struct ui_queue_stats last_queue;
+  static time_t last_time = 0;
+  struct ev_stats st;
+  struct ui_queue_stats qs;
+  time_t now = time(NULL);
+  unsigned polls, packets;
+
+  if (now - last_time < 10) return;
+  ev_get_stats(&st);
+  polls = st.polls - last.polls;
+  packets = st.packets - last.packets;
+  // wakeups without packets come from devices the UI doesn't use
+  if (polls && last_time) {
+    fprintf(stdout, "input: %.1f wakeups/s, %u packets, %u events, %.1f syscalls/packet, %u ms cpu in %lds\n",
+            (float) polls / (now - last_time), packets, st.events - last.events,
+            packets ? (float) (polls + st.reads - last.reads) / packets : 0.0f,
+            st.cpu_ms >= last.cpu_ms ? st.cpu_ms - last.cpu_ms : st.cpu_ms,
+            (long) (now - last_time));
+  }
+  ui_get_queue_stats(&qs);
+  if (qs.queued != last_queue.queued && last_time) {
+    fprintf(stdout, "input: %u queued, %u drags coalesced, %u dropped, depth %u (max %u) in %lds\n",
+            qs.queued - last_queue.queued, qs.coalesced - last_queue.coalesced,
+            qs.dropped - last_queue.dropped, qs.depth, qs.max_depth,
+            (long) (now - last_time));
+  }
+  last = st;
+  last_queue = qs;
+  last_time = now;
+}
+
+/*
+ * Input-to-photon latency: from the kernel timestamp of an event (see
+ * ev_get()) to the gr_flip() of the first frame drawn once the menu code
+ * handled it, i.e. came back to ui_wait_input() for the next one.
+ */
+#define LAT_SAMPLES 512
+#define LAT_PENDING 32
+#define LAT_TYPES 4     // UINPUTEVENT_TYPE_*
+
+enum { LAT_HANDED_OUT, LAT_HANDLED, LAT_DRAWING };
+
+static const char *lat_names[LAT_TYPES] = { "key", "touch", "drag", "release" };
+static struct {
+  unsigned us[LAT_SAMPLES];     // the last ones
+  unsigned count;
+} lat[LAT_TYPES];
+static struct {
+  struct timeval time;
+  int utype;
+  int state;
+} lat_pending[LAT_PENDING];
+static int lat_pending_count = 0;
+static pthread_mutex_t lat_mutex = PTHREAD_MUTEX_INITIALIZER;
+// bottom lines of the log tab, bumped when they change
+static char lat_summary[LAT_TYPES][MAX_COLS];
+static unsigned lat_serial = 0;
+
+// the menu code is done with what ui_wait_input() gave it
+static void lat_handled(void)
+{
+  int i;
+
+  pthread_mutex_lock(&lat_mutex);
+  for (i = 0; i < lat_pending_count; i++) {
+    if (lat_pending[i].state == LAT_HANDED_OUT)
+      lat_pending[i].state = LAT_HANDLED;
+  }
+  pthread_mutex_unlock(&lat_mutex);
+}
+
+static void lat_handed_out(const struct ui_input_event *ev)
+{
+  pthread_mutex_lock(&lat_mutex);
+  // not drawn for long, e.g. while a script runs
+  if (lat_pending_count == LAT_PENDING)
+    memmove(&lat_pending[0], &lat_pending[1], sizeof(lat_pending[0]) * --lat_pending_count);
+  lat_pending[lat_pending_count].time = ev->time;
+  lat_pending[lat_pending_count].utype = ev->utype;
+  lat_pending[lat_pending_count].state = LAT_HANDED_OUT;
+  lat_pending_count++;
+  pthread_mutex_unlock(&lat_mutex);
+}
+
+static void lat_frame_begin(void)
+{
+  int i;
+
+  pthread_mutex_lock(&lat_mutex);
+  for (i = 0; i < lat_pending_count; i++) {
+    if (lat_pending[i].state == LAT_HANDLED)
+      lat_pending[i].state = LAT_DRAWING;
+  }
+  pthread_mutex_unlock(&lat_mutex);
+}
+
+// after gr_flip(), the frame shows the events handled before it began
+static void lat_frame_end(void)
+{
+  struct timespec now;
+  int i, n = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  pthread_mutex_lock(&lat_mutex);
+  for (i = 0; i < lat_pending_count; i++) {
+    int type = lat_pending[i].utype;
+    if (lat_pending[i].state != LAT_DRAWING) {
+      lat_pending[n++] = lat_pending[i];
+      continue;
     }
-    else {
-      if(bounceback_start>bounceback_targetpos) {
-        menutop_diff=bounceback_targetpos+pway;
-      }
-      else {
-        menutop_diff=bounceback_targetpos-pway;
-      }
+    if (type >= 0 && type < LAT_TYPES) {
+      long long us = (now.tv_sec - lat_pending[i].time.tv_sec) * 1000000LL +
+                     now.tv_nsec / 1000 - lat_pending[i].time.tv_usec;
+      lat[type].us[lat[type].count++ % LAT_SAMPLES] = us > 0 ? us : 0;
     }
   }
+  lat_pending_count = n;
+  pthread_mutex_unlock(&lat_mutex);
+}
 
-  draw_background_locked(gCurrentIcon);
-  draw_progress_locked();
+static void lat_forget_pending(void)
+{
+  pthread_mutex_lock(&lat_mutex);
+  lat_pending_count = 0;
+  pthread_mutex_unlock(&lat_mutex);
+}
 
-  if (show_text) {
-    i = 0;
+static int cmp_unsigned(const void *a, const void *b)
+{
+  unsigned x = *(const unsigned *) a, y = *(const unsigned *) b;
+  return x < y ? -1 : x > y;
+}
 
-    // for logs, no menu items (define to move later)
-    #define TAB_LOG 2
+// nearest rank percentiles of the last samples, returns how many
+static unsigned lat_percentiles(int type, unsigned *p50, unsigned *p95, unsigned *p99)
+{
+  unsigned sorted[LAT_SAMPLES];
+  unsigned n;
+
+  pthread_mutex_lock(&lat_mutex);
+  n = lat[type].count < LAT_SAMPLES ? lat[type].count : LAT_SAMPLES;
+  memcpy(sorted, lat[type].us, n * sizeof(sorted[0]));
+  pthread_mutex_unlock(&lat_mutex);
+  if (n == 0)
+    return 0;
+
+  qsort(sorted, n, sizeof(sorted[0]), cmp_unsigned);
+  *p50 = sorted[(n * 50 + 99) / 100 - 1];
+  *p95 = sorted[(n * 95 + 99) / 100 - 1];
+  *p99 = sorted[(n * 99 + 99) / 100 - 1];
+  return n;
+}
 
-    if (activeTab != TAB_LOG) {
-      // draw menu
-      gr_setfont(FONT_ITEM);
-
-      for (; i < menu_items; ++i) {
-        if (i == menu_sel) {
-          // draw item
-          gr_color(0, 0, 0, 255);
-          marginTop = draw_menu_item(marginTop, i);
-        } else {
-          gr_color(255, 255, 255, 255);
-          marginTop = draw_menu_item(marginTop, i);
-        }
-      }
-      ++i;
+// refresh the log tab lines every second, and log them every 10s
+static void lat_report(void)
+{
+  static unsigned last_counts[LAT_TYPES], logged_counts[LAT_TYPES];
+  static time_t last_time = 0, logged_time = 0;
+  time_t now = time(NULL);
+  unsigned p50, p95, p99, n;
+  int i, changed = 0, log;
+
+  if (now == last_time) return;
+  last_time = now;
+  log = now - logged_time >= 10;
+  if (log) logged_time = now;
+
+  for (i = 0; i < LAT_TYPES; i++) {
+    if (lat[i].count == last_counts[i] && !(log && lat[i].count != logged_counts[i]))
+      continue;
+    n = lat_percentiles(i, &p50, &p95, &p99);
+    if (n == 0) continue;
+    if (lat[i].count != last_counts[i]) {
+      snprintf(lat_summary[i], sizeof(lat_summary[i]),
+               "latency %s: p50 %.1f p95 %.1f p99 %.1f ms (%u)", lat_names[i],
+               p50 / 1000.0, p95 / 1000.0, p99 / 1000.0, lat[i].count);
+      last_counts[i] = lat[i].count;
+      changed = 1;
+    }
+    if (log && lat[i].count != logged_counts[i]) {
+      fprintf(stdout, "latency: %s p50 %u p95 %u p99 %u us, %u events\n", lat_names[i],
+              p50, p95, p99, lat[i].count);
+      logged_counts[i] = lat[i].count;
+    }
+  }
+  if (changed) lat_serial++;
+}
 
-    } else {
+/* Writes the percentiles and the last samples of each type to
+ * $MINUI_LATENCY_DUMP, or latency.txt in the resource cache folder. */
+static void lat_dump(void)
+{
+  const char *path = getenv("MINUI_LATENCY_DUMP");
+  const char *dir;
+  char buf[256];
+  unsigned p50, p95, p99, n, j;
+  FILE *f;
+  int i;
 
-      //log background
-      gr_color(50, 50, 50, 160);
-      gr_fill(0, 0, gr_fb_width(), gr_fb_height());
+  if (path == NULL) {
+    dir = res_cache_folder();
+    if (dir == NULL) return;
+    snprintf(buf, sizeof(buf), "%s/latency.txt", dir);
+    path = buf;
+  }
+  if (*path == '\0') return;
+  for (i = 0; i < LAT_TYPES && lat[i].count == 0; i++) ;
+  if (i == LAT_TYPES) return;
+
+  f = fopen(path, "w");
+  if (f == NULL) return;
+  fprintf(f, "# input-to-photon latency in us: type events p50 p95 p99, then the last samples\n");
+  for (i = 0; i < LAT_TYPES; i++) {
+    n = lat_percentiles(i, &p50, &p95, &p99);
+    if (n == 0) continue;
+    fprintf(f, "%s %u %u %u %u\n", lat_names[i], lat[i].count, p50, p95, p99);
+  }
+  for (i = 0; i < LAT_TYPES; i++) {
+    n = lat[i].count < LAT_SAMPLES ? lat[i].count : LAT_SAMPLES;
+    if (n == 0) continue;
+    fprintf(f, "%s:", lat_names[i]);
+    // oldest first
+    for (j = lat[i].count - n; j < lat[i].count; j++)
+      fprintf(f, " %u", lat[i].us[j % LAT_SAMPLES]);
+    fprintf(f, "\n");
+  }
+  fclose(f);
+}
 
-    }
+static void status_sample(void)
+{
+  time_t now = time(NULL);
 
-    // small font for status bar
-    gr_setfont(FONT_LOGS);
+  if (now != status_time_sampled) {
+    ui_get_time(status_time);
+    ui_get_usbstate(status_usb);
+#ifdef BOARD_WITH_CPCAP
+    status_battery = battery_level();
+#endif
+    status_time_sampled = now;
+  }
+}
 
-    // draw statusbar
-    int statusbar_right = 10;
-    gr_color(0, 0, 0, 160);
+static void draw_statusbar(void)
+{
+  intptr_t in[LAYER_MAX_INPUTS] = { 0 };
+  char str[16];
+  int ret;
+
+  status_sample();
+  in[0] = hash_str(hash_str(5381, status_time), status_usb);
+  in[1] = status_battery;
+  ret = layer_begin(&layers[LAYER_STATUS], 0, 0, gr_fb_width(), STATUSBAR_HEIGHT, 1, in);
+  if (ret == 0) {
+    gr_blit(layers[LAYER_STATUS].surface, 0, 0, gr_fb_width(), STATUSBAR_HEIGHT, 0, 0);
+    return;
+  }
+
+  // small font for status bar
+  gr_setfont(FONT_LOGS);
+
+  // draw statusbar
+  int statusbar_right = 10;
+  gr_color(0, 0, 0, 160);
+  if (ret > 0)
+    gr_clear();
+  else
     gr_fill(0, 0, gr_fb_width(), STATUSBAR_HEIGHT);
 
-    // print version
-    int yBar = gr_getfont_cheight()/2 + STATUSBAR_HEIGHT/2 - gr_getfont_cheightfix();
-    gr_color(0, 170, 255, 255);
-    gr_text(0, yBar, "Bootmenu v" BOOTMENU_VERSION);
+  // print version
+  int yBar = gr_getfont_cheight()/2 + STATUSBAR_HEIGHT/2 - gr_getfont_cheightfix();
+  gr_color(0, 170, 255, 255);
+  gr_text(0, yBar, "Bootmenu v" BOOTMENU_VERSION);
 
-    // draw clock
-    char str[16]="";
-    ui_get_time(str);
-    gr_text(gr_fb_width()/2 - 5*gr_getfont_cwidth()/2, yBar, str);
+  // draw clock
+  gr_text(gr_fb_width()/2 - 5*gr_getfont_cwidth()/2, yBar, status_time);
 
-    ui_get_usbstate(str);
-    gr_text(gr_fb_width()/4 * 3, yBar, str);
+  gr_text(gr_fb_width()/4 * 3, yBar, status_usb);
 
 #ifdef BOARD_WITH_CPCAP
-    // draw battery
-    int level = battery_level();
-    sprintf(str, "%d%%", level);
+  // draw battery
+  sprintf(str, "%d%%", status_battery);
 
-    gr_text(gr_fb_width() - strlen(str)*gr_getfont_cwidth() - statusbar_right, yBar, str);
+  gr_text(gr_fb_width() - strlen(str)*gr_getfont_cwidth() - statusbar_right, yBar, str);
 #endif
 
-    // draw tabcontrol
-    int tableft=0;
+  if (ret > 0) {
+    layer_end();
+    gr_blit(layers[LAYER_STATUS].surface, 0, 0, gr_fb_width(), STATUSBAR_HEIGHT, 0, 0);
+  }
+}
+
+static void draw_tabs(void)
+{
+  intptr_t in[LAYER_MAX_INPUTS] = { 0 };
+  int i, tableft = 0;
+  int ret;
 
+  in[0] = (intptr_t) tabitems;
+  in[1] = activeTab;
+  for (i = 0; tabitems && tabitems[i]; ++i)
+    in[2] = hash_str(in[2], tabitems[i]);
+
+  ret = layer_begin(&layers[LAYER_TABS], 0, STATUSBAR_HEIGHT, gr_fb_width(), TABCONTROL_HEIGHT, 0, in);
+  if (ret != 0) {
+    // draw tabcontrol
     gr_setfont(FONT_HEAD);
     gr_color(0, 0, 0, 255);
 
@@ -439,41 +753,306 @@ static void draw_screen_locked(void)
         tableft = drawTab(tableft, tabitems[i], active);
       }
     }
+    if (ret < 0) return;
+    layer_end();
+  }
+  gr_blit(layers[LAYER_TABS].surface, 0, 0, gr_fb_width(), TABCONTROL_HEIGHT, 0, STATUSBAR_HEIGHT);
+}
 
-    // draw divider-line
+/* The whole list is one layer, scrolling only moves the part of it that is
+ * blitted. Items are re-rendered when the selection or the touched item
+ * changes. */
+static void draw_menu(int marginTop)
+{
+  intptr_t in[LAYER_MAX_INPUTS] = { 0 };
+  int width = square_inner_right - square_inner_left;
+  int height = ui_get_menu_height();
+  int i, top, ret = -1;
+
+  // only MENUITEM_SMALL items are drawn, the others would leave holes
+  for (i = 0; i < menu_items; ++i) {
+    if (menu[i].type != MENUITEM_SMALL) break;
+  }
+
+  if (i == menu_items && height > 0 && width > 0 &&
+      width * height * 4 <= LAYER_MENU_MAX_BYTES) {
+    in[0] = (intptr_t) menu;
+    in[1] = menu_items;
+    in[2] = show_menu_selection ? menu_sel : -1;
+    in[3] = -1;
+    if (enable_scrolling == 0) {
+      for (i = 0; i < menu_items; ++i) {
+        if (ui_inside_menuitem(i, pointerx_start, pointery_start)) {
+          in[3] = i;
+          in[4] = ui_inside_menuitem(i, pointerx, pointery);
+          break;
+        }
+      }
+    }
+    in[5] = width;
+    for (i = 0; i < menu_items; ++i)
+      in[6] = hash_str(in[6], menu[i].title);
+
+    // rendered with the list top at 0, see draw_menu_item
+    ret = layer_begin(&layers[LAYER_MENU], square_inner_left, 0, width, height, 0, in);
+  }
+
+  if (ret != 0) {
+    gr_setfont(FONT_ITEM);
+    top = (ret > 0) ? 0 : marginTop;
+    for (i = 0; i < menu_items; ++i) {
+      if (ret > 0)
+        top = draw_menu_item(top, i, 0, height);
+      else
+        top = draw_menu_item(top, i, square_inner_top, square_inner_bottom);
+    }
+    if (ret < 0) return;
+    layer_end();
+  }
+
+  // visible part of the list
+  int t = marginTop > square_inner_top ? marginTop : square_inner_top;
+  int b = marginTop + height < square_inner_bottom ? marginTop + height : square_inner_bottom;
+  if (t < b)
+    gr_blit(layers[LAYER_MENU].surface, 0, t - marginTop, width, b - t, square_inner_left, t);
+}
+
+/* Log tab: everything below the tabs, background included, is one layer */
+static void draw_log_pane(void)
+{
+  intptr_t in[LAYER_MAX_INPUTS] = { 0 };
+  int top = STATUSBAR_HEIGHT+TABCONTROL_HEIGHT;
+  int i, row, ret = -1;
+  char str[16];
+
+  // the progress bar is animated, draw everything over it each time
+  if (gProgressBarType == PROGRESSBAR_TYPE_NONE) {
+    in[0] = text_serial;
+    in[1] = text_top;
+    in[2] = (intptr_t) gCurrentIcon;
+    in[3] = lat_serial;
+    ret = layer_begin(&layers[LAYER_LOG], 0, top, gr_fb_width(), gr_fb_height() - top, 0, in);
+    if (ret > 0) {
+      // same as what is below the log text on screen
+      draw_background_locked(gCurrentIcon);
+      gr_color(50, 50, 50, 160);
+      gr_fill(0, 0, gr_fb_width(), gr_fb_height());
+      gr_color(0, 170, 255, 255);
+      gr_drawLine(0, top, gr_fb_width(), top, 4);
+    }
+  }
+
+  if (ret < 0) {
+    gr_color(50, 50, 50, 160);
+    gr_fill(0, top, gr_fb_width(), gr_fb_height());
     gr_color(0, 170, 255, 255);
-    gr_drawLine(0, STATUSBAR_HEIGHT+TABCONTROL_HEIGHT, gr_fb_width(), STATUSBAR_HEIGHT+TABCONTROL_HEIGHT, 4);
+    gr_drawLine(0, top, gr_fb_width(), top, 4);
+  }
 
-    // draw logs
+  if (ret != 0) {
     gr_setfont(FONT_LOGS);
     gr_color(192, 192, 192, 255);
 
-    if (activeTab == TAB_LOG) {
+    int ln_h = gr_getfont_cheight();
+    int full_rows = (gr_fb_height() - top - 24) / ln_h;
+    int log_rows = full_rows;
 
-      int row;
-      int ln_h = gr_getfont_cheight();
-      int full_rows = (gr_fb_height() - (STATUSBAR_HEIGHT+TABCONTROL_HEIGHT) - 24) / ln_h;
+    sprintf(str, "%d rows", full_rows);
+    gr_text(400, top + 22, str);
 
-      sprintf(str, "%d rows", full_rows);
-      gr_text(400, STATUSBAR_HEIGHT+TABCONTROL_HEIGHT + 22, str);
+    // the latency lines go below the log
+    for (i = 0; i < LAT_TYPES; i++)
+      if (lat_summary[i][0]) log_rows--;
 
-      for (i=0; i < full_rows; ++i) {
-        row = (i+text_top) % full_rows;
-        if (row >= MAX_ROWS) break;
-        if (strlen(text[row]))
-          gr_text(2, STATUSBAR_HEIGHT+TABCONTROL_HEIGHT + 22 + ln_h*i, text[row]);
-        else {
-          sprintf(str, "%d (%d) empty", i, row);
-        }
+    for (i=0; i < log_rows; ++i) {
+      row = (i+text_top) % full_rows;
+      if (row >= MAX_ROWS) break;
+      if (strlen(text[row]))
+        gr_text(2, top + 22 + ln_h*i, text[row]);
+    }
+
+    gr_color(0, 170, 255, 255);
+    for (i = 0; i < LAT_TYPES; i++) {
+      if (lat_summary[i][0])
+        gr_text(2, top + 22 + ln_h*log_rows++, lat_summary[i]);
+    }
+    if (ret < 0) return;
+    layer_end();
+  }
+
+  gr_blit(layers[LAYER_LOG].surface, 0, 0, gr_fb_width(), gr_fb_height() - top, 0, top);
+}
+
+/*
+ * Partial frames: the draw surface keeps the last frame, so when only the
+ * status bar, the tab bar or some menu rows changed, only their rects are
+ * drawn again (background included, cut with gr_set_clip) and gr_flip()
+ * only copies those. Any other change redraws the whole screen.
+ */
+#define FRAME_MAX_ROWS 32
+
+// for logs, no menu items (define to move later)
+#define TAB_LOG 2
+
+struct ui_frame {
+  int valid;                  // 0 to redraw everything
+  intptr_t screen[24];        // what the whole screen depends on
+  intptr_t status, tabs;
+  intptr_t rows[FRAME_MAX_ROWS];
+};
+
+static struct ui_frame frame_last;
+
+static void draw_screen_locked(void);
+
+static void frame_state(struct ui_frame *f)
+{
+  float progress = gProgressScopeStart + gProgress * gProgressScopeSize;
+  int i, n = 0;
+
+  memset(f, 0, sizeof(*f));
+  // animated, or too many rows to compare
+  f->valid = !enable_bounceback && menu_items <= FRAME_MAX_ROWS
+             && gProgressBarType != PROGRESSBAR_TYPE_INDETERMINATE;
+
+  f->screen[n++] = show_menu;
+  f->screen[n++] = show_text;
+  f->screen[n++] = activeTab;
+  f->screen[n++] = (intptr_t) gCurrentIcon;
+  f->screen[n++] = gProgressBarType;
+  if (gProgressBarType != PROGRESSBAR_TYPE_NONE) {
+    f->screen[n++] = (intptr_t) (progress * 65536);
+    f->screen[n++] = show_percent ? (intptr_t) (percent * 100) : -1;
+  }
+  f->screen[n++] = ui_get_menu_top();
+  f->screen[n++] = (intptr_t) menu;
+  f->screen[n++] = menu_items;
+  f->screen[n++] = enable_scrolling;
+  f->screen[n++] = pointerx;
+  f->screen[n++] = pointery;
+  f->screen[n++] = pointerx_start;
+  f->screen[n++] = pointery_start;
+  f->screen[n++] = text_serial;
+  f->screen[n++] = text_top;
+  f->screen[n++] = lat_serial;
+  f->screen[n++] = gr_fb_width();
+  f->screen[n++] = gr_fb_height();
+
+  status_sample();
+  f->status = hash_str(hash_str(5381, status_time), status_usb) * 33 + status_battery;
+  f->tabs = (intptr_t) tabitems;
+  for (i = 0; tabitems && tabitems[i]; ++i)
+    f->tabs = hash_str(f->tabs, tabitems[i]);
+
+  for (i = 0; i < menu_items && i < FRAME_MAX_ROWS; ++i) {
+    f->rows[i] = hash_str(5381, menu[i].title);
+    if (show_menu_selection && menu_sel == i)
+      f->rows[i] = ~f->rows[i];
+  }
+}
+
+static void draw_screen_clipped(int left, int top, int right, int bottom)
+{
+  gr_set_clip(left, top, right, bottom);
+  draw_screen_locked();
+  gr_reset_clip();
+}
+
+// Draw what changed since the last frame, everything if unsure.
+// Should only be called with gUpdateMutex locked.
+static void draw_frame_locked(void)
+{
+  struct ui_frame f;
+  int i, top;
+
+  frame_state(&f);
+  if (!f.valid || !frame_last.valid || memcmp(f.screen, frame_last.screen, sizeof(f.screen))) {
+    draw_screen_locked();
+    frame_last = f;
+    return;
+  }
+
+  if (f.status != frame_last.status)
+    draw_screen_clipped(0, 0, gr_fb_width(), STATUSBAR_HEIGHT);
+  if (f.tabs != frame_last.tabs)
+    draw_screen_clipped(0, STATUSBAR_HEIGHT, gr_fb_width(), STATUSBAR_HEIGHT+TABCONTROL_HEIGHT);
+
+  // the rows, where the list is visible
+  top = ui_get_menu_top();
+  for (i = 0; i < menu_items; ++i) {
+    int bottom = top + get_menuitem_height(i);
+    if (f.rows[i] != frame_last.rows[i] && show_text && activeTab != TAB_LOG) {
+      draw_screen_clipped(square_inner_left, top > square_inner_top ? top : square_inner_top,
+                          square_inner_right, bottom < square_inner_bottom ? bottom : square_inner_bottom);
+    }
+    top = bottom;
+  }
+  frame_last = f;
+}
+
+// Redraw everything on the screen.  Does not flip pages.
+// Should only be called with gUpdateMutex locked.
+static void draw_screen_locked(void)
+{
+  if (show_menu != 1) return;
+
+  int i;
+  int marginTop = ui_get_menu_top();
+  struct timeval bouncediff, tvNow;
+  gettimeofday(&tvNow, NULL);
+
+
+  if (enable_bounceback == 1) {
+    timeval_subtract(&bouncediff, &tvNow, &bounceback_start_time);
+    int t0 = BOUNCEBACK_TIME*1000;
+    int t1 = t0- (bouncediff.tv_sec*1000000+bouncediff.tv_usec);
+    int way = abs(bounceback_start-bounceback_targetpos);
+    //int pway = round((double)way/t0*t1);
+    int pway = way/t0*t1;
+
+    if(pway<=0) {
+      enable_bounceback=0;
+      menutop_diff=bounceback_targetpos;
+    }
+    else {
+      if(bounceback_start>bounceback_targetpos) {
+        menutop_diff=bounceback_targetpos+pway;
+      }
+      else {
+        menutop_diff=bounceback_targetpos-pway;
       }
+    }
+  }
+
+  draw_background_locked(gCurrentIcon);
+  draw_progress_locked();
 
+  if (show_text) {
+    if (activeTab != TAB_LOG) {
+      draw_menu(marginTop);
     } else {
+      // log background, below the tabs it is part of the log layer
+      gr_color(50, 50, 50, 160);
+      gr_fill(0, 0, gr_fb_width(), STATUSBAR_HEIGHT);
+    }
+
+    draw_statusbar();
+    draw_tabs();
 
+    // draw divider-line
+    gr_color(0, 170, 255, 255);
+    gr_drawLine(0, STATUSBAR_HEIGHT+TABCONTROL_HEIGHT, gr_fb_width(), STATUSBAR_HEIGHT+TABCONTROL_HEIGHT, 4);
+
+    // draw logs
+    if (activeTab == TAB_LOG) {
+      draw_log_pane();
+    } else {
       // tailed log on the bottom
+      gr_setfont(FONT_LOGS);
+      gr_color(192, 192, 192, 255);
       for (i=0; i < text_rows; ++i) {
         draw_log_line(i, text[(i+text_top) % text_rows]);
       }
-
     }
 
     // DEBUG: Pointer-location
@@ -520,10 +1099,38 @@ static void recalcSquare()
 
 // Redraw everything on the screen and flip the screen (make it visible).
 // Should only be called with gUpdateMutex locked.
+static struct timeval ui_start_time;
+static int ui_first_frame = 1;
+static int ui_preloaded = 0;
+static int ui_initialized = 0;
+// graphics released by ui_handoff(), nothing may be drawn
+static int ui_handed_off = 0;
+
 static void update_screen_locked(void)
 {
-  draw_screen_locked();
+  if (ui_handed_off)
+    return;
+
+  lat_frame_begin();
+  // rasterized by one thread per band on SMP (BOARD_BOOTMENU_BANDS)
+  gr_batch_begin();
+  draw_frame_locked();
+  gr_batch_end();
   gr_flip();
+  lat_frame_end();
+
+  if (show_menu && splash_menu && menu_source == splash_menu)
+    splash_drawn = 1;
+
+  if (ui_first_frame) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    fprintf(stdout, "first frame: %ld ms after start (%s)\n",
+            (now.tv_sec - ui_start_time.tv_sec) * 1000L +
+            (now.tv_usec - ui_start_time.tv_usec) / 1000L,
+            ui_preloaded ? "preloaded" : "serial");
+    ui_first_frame = 0;
+  }
 }
 
 // Updates only the progress bar, if possible, otherwise redraws the screen.
@@ -587,7 +1194,13 @@ static void *input_thread(void *cookie)
     int state = 0;
 
     do {
-      ev_get(&ev, 0);
+      if (ev_get(&ev, 0) < 0) {
+        // suspended by evt_exit(), which waits for this thread to return
+        if (!pthread_equal(t_input, pthread_self()))
+          return NULL;
+        ev.type = EV_SYN;
+        continue;
+      }
       uev.time = ev.time;
       uev.type = ev.type;
       uev.code = ev.code;
@@ -651,7 +1264,6 @@ static void *input_thread(void *cookie)
       }
     } while ((ev.type != EV_KEY && ev.type != EV_ABS) || ev.code > KEY_MAX);
 
-    pthread_mutex_lock(&key_queue_mutex);
     if (!fake_key) {
         // our "fake" keys only report a key-down event (no
         // key-up), so don't record them in the key_pressed
@@ -660,12 +1272,8 @@ static void *input_thread(void *cookie)
         redraw_idle_timeout = 50;
     }
     fake_key = 0;
-    const int queue_max = sizeof(key_queue) / sizeof(key_queue[0]);
-    if (ev.value > 0 && key_queue_len < queue_max) {
-        key_queue[key_queue_len++] = uev;
-        pthread_cond_signal(&key_queue_cond);
-    }
-    pthread_mutex_unlock(&key_queue_mutex);
+    if (ev.value > 0)
+        key_queue_push(&uev);
 
     if (ev.type!= EV_ABS && ev.value > 0 && device_toggle_display(key_pressed, ev.code)) {
         ui_setTab_next();
@@ -706,6 +1314,9 @@ static void *redraw_thread(void *cookie)
     // skip 4/5 of the "slow" redraw work in idle state, to reduce the maximum wait on exit from idle
     if ((redraw_idle_timeout || !counter)) {
       update_screen_locked();
+      layers_report();
+      input_report();
+      lat_report();
       redraw_idle_timeout-=10;
       if (redraw_idle_timeout < 0) redraw_idle_timeout = 0;
     }
@@ -715,12 +1326,15 @@ static void *redraw_thread(void *cookie)
   return NULL;
 }
 
-int ui_create_bitmaps()
+static int ui_load_bitmaps(int format)
 {
   int i, result=0;
+  struct timeval t0, t1;
+  struct res_cache_stats st;
 
+  gettimeofday(&t0, NULL);
   for (i = 0; BITMAPS[i].name != NULL; ++i) {
-    result = res_create_surface(BITMAPS[i].name, BITMAPS[i].surface);
+    result = res_create_surface_format(BITMAPS[i].name, BITMAPS[i].surface, format, -1);
     if (result < 0) {
       if (result == -2) {
         LOGI("Bitmap %s missing header\n", BITMAPS[i].name);
@@ -730,12 +1344,112 @@ int ui_create_bitmaps()
       *BITMAPS[i].surface = NULL;
     }
   }
+  gettimeofday(&t1, NULL);
+
+  // cold: something was decoded, warm: all from the cache
+  res_get_cache_stats(&st);
+  fprintf(stdout, "bitmaps: %ld us %s, %u cached, %u decoded, %u shared\n",
+          (t1.tv_sec - t0.tv_sec) * 1000000L + (t1.tv_usec - t0.tv_usec),
+          st.misses ? "cold" : "warm", st.hits, st.misses, st.shared);
   return result;
 }
 
+int ui_create_bitmaps()
+{
+  return ui_load_bitmaps(gr_draw_format());
+}
+
+/*
+ * Background loading of what ui_init() needs, started by ui_preload()
+ * while bootmenu still runs its scripts: fonts and framebuffer first,
+ * then the bitmaps. ui_init() only waits for the stages it needs next.
+ */
+enum { PRELOAD_NONE, PRELOAD_RUNNING, PRELOAD_FB, PRELOAD_DONE };
+
+static pthread_t t_preload;
+static pthread_mutex_t preload_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t preload_cond = PTHREAD_COND_INITIALIZER;
+static int preload_stage = PRELOAD_NONE;
+static int preload_format = -1;   // bitmaps were loaded for it
+
+static void preload_set_stage(int stage)
+{
+  pthread_mutex_lock(&preload_mutex);
+  preload_stage = stage;
+  pthread_cond_broadcast(&preload_cond);
+  pthread_mutex_unlock(&preload_mutex);
+}
+
+static void *preload_thread(void *cookie)
+{
+  int format = gr_preload();
+  preload_set_stage(PRELOAD_FB);
+
+  if (format >= 0) {
+    ui_load_bitmaps(format);
+    preload_format = format;
+  }
+  preload_set_stage(PRELOAD_DONE);
+  return NULL;
+}
+
+// returns 0 if nothing was preloaded
+static int preload_wait(int stage)
+{
+  pthread_mutex_lock(&preload_mutex);
+  if (preload_stage == PRELOAD_NONE) {
+    pthread_mutex_unlock(&preload_mutex);
+    return 0;
+  }
+  while (preload_stage < stage)
+    pthread_cond_wait(&preload_cond, &preload_mutex);
+  pthread_mutex_unlock(&preload_mutex);
+  if (stage == PRELOAD_DONE) {
+    pthread_join(t_preload, NULL);
+    preload_set_stage(PRELOAD_NONE);
+  }
+  return 1;
+}
+
+void ui_preload(void)
+{
+  const char *env = getenv("MINUI_PRELOAD");
+#ifdef BOARD_BOOTMENU_NO_PRELOAD
+  int enable = 0;
+#else
+  int enable = 1;
+#endif
+
+  gettimeofday(&ui_start_time, NULL);
+  if (env)
+    enable = atoi(env);
+  if (!enable || preload_stage != PRELOAD_NONE)
+    return;
+
+  // /cache may not be mounted yet, write the surface cache at ui_init()
+  res_cache_defer(1);
+  preload_stage = PRELOAD_RUNNING;
+  if (pthread_create(&t_preload, NULL, preload_thread, NULL) != 0) {
+    preload_stage = PRELOAD_NONE;
+    res_cache_defer(0);
+  }
+}
+
+void ui_preload_drop(void)
+{
+  if (preload_wait(PRELOAD_DONE))
+    gr_preload_release();
+}
+
 void ui_init(void)
 {
+  if (ui_start_time.tv_sec == 0)
+    gettimeofday(&ui_start_time, NULL);
+
+  ui_preloaded = preload_wait(PRELOAD_FB);
   gr_init();
+  ui_initialized = 1;
+  ui_handed_off = 0;
   ev_init();
   recalcSquare();
 
@@ -747,7 +1461,14 @@ void ui_init(void)
   text_cols = gr_fb_width() / gr_getfont_cwidth();
   if (text_cols > MAX_COLS - 1) text_cols = MAX_COLS - 1;
 
-  ui_create_bitmaps();
+  if (!preload_wait(PRELOAD_DONE)) {
+    ui_create_bitmaps();
+  } else if (preload_format != gr_draw_format()) {
+    // loaded for another format, gr_init() didn't get the mode expected
+    ui_free_bitmaps();
+    ui_create_bitmaps();
+  }
+  res_cache_defer(0);
 
   pthread_attr_t attr;
   pthread_attr_init(&attr);
@@ -768,7 +1489,6 @@ void ui_free_bitmaps(void)
   //free bitmaps
   for (i = 0; BITMAPS[i].name != NULL; ++i) {
     if (BITMAPS[i].surface != NULL) {
-      ui_print("free bitmap %d @ %x\n", i, (unsigned) BITMAPS[i].surface);
       res_free_surface(BITMAPS[i].surface);
     }
   }
@@ -786,14 +1506,16 @@ void evt_init(void)
 
 void evt_exit(void)
 {
+  pthread_t t = t_input;
+
   if (evt_enabled) {
 
-    if (t_input != 0) {
-      pthread_detach(t_input);
-      t_input = 0;
-      usleep(1000);
-    }
-    ev_exit();
+    t_input = 0;
+    // the devices stay open, the thread returns once woken
+    ev_suspend();
+    // no two threads may read the devices after the next evt_init()
+    if (t != 0 && t != pthread_self())
+      pthread_join(t, NULL);
 
   }
   evt_enabled = 0;
@@ -808,8 +1530,84 @@ void ui_stop_redraw(void)
   }
 }
 
+/*
+ * Low memory handoff: before exec'ing recovery or 2nd-init, the layers,
+ * bitmaps, fonts and framebuffer buffers are given back, along with
+ * anything else left in the minui arena. Text, menu and background are
+ * kept, the rest is loaded again when the UI is shown next.
+ */
+static int ui_handoff_icon = -1;   // background shown at the handoff
+
+// Should only be called with gUpdateMutex locked.
+static void ui_release_locked(void)
+{
+  int i;
+
+  ui_handoff_icon = -1;
+  for (i = 0; i < NUM_BACKGROUND_ICONS; i++) {
+    if (gCurrentIcon && gCurrentIcon == gBackgroundIcon[i])
+      ui_handoff_icon = i;
+  }
+  gCurrentIcon = NULL;
+
+  layers_free();
+  ui_free_bitmaps();
+  frame_last.valid = 0;
+  // the main menu as last shown, for the next start
+  gr_splash_save();
+  splash_drawn = 0;
+}
+
+size_t ui_handoff(void)
+{
+  size_t bytes, leaked;
+
+  if (!ui_initialized || ui_handed_off)
+    return 0;
+
+  evt_exit();
+  ui_stop_redraw();
+  // what is left won't be drawn before the exec
+  lat_forget_pending();
+  lat_dump();
+
+  bytes = arena_bytes(&gr_arena);
+  pthread_mutex_lock(&gUpdateMutex);
+  ui_release_locked();
+  // stays on screen while the script runs
+  gr_release();
+  ui_handed_off = 1;
+  pthread_mutex_unlock(&gUpdateMutex);
+  // what is still allocated was not freed by its owner
+  leaked = arena_release(&gr_arena);
+
+  LOGI("handoff: %u KiB released (%u KiB unowned)\n",
+       (unsigned) (bytes / 1024), (unsigned) (leaked / 1024));
+  return bytes;
+}
+
+// after ui_handoff(), back on the first call that shows something or
+// waits for input: an exec that returns straight into another pays nothing
+static void ui_restore(void)
+{
+  if (!ui_initialized || !ui_handed_off)
+    return;
+
+  gr_init();
+  ui_create_bitmaps();
+
+  pthread_mutex_lock(&gUpdateMutex);
+  if (ui_handoff_icon >= 0)
+    gCurrentIcon = gBackgroundIcon[ui_handoff_icon];
+  ui_handed_off = 0;
+  pthread_mutex_unlock(&gUpdateMutex);
+
+  evt_init();
+}
+
 void ui_resume_redraw(void)
 {
+  // draws nothing until ui_restore()
   if (t_redraw) return;
 
   pthread_create(&t_redraw, NULL, redraw_thread, NULL);
@@ -822,9 +1620,16 @@ void ui_final(void)
   ui_show_text(0);
   ui_stop_redraw();
 
+  pthread_mutex_lock(&gUpdateMutex);
+  if (!ui_handed_off)
+    ui_release_locked();
+  // also after a handoff, the next boot stage gets the final mode
   gr_exit();
+  ui_initialized = 0;
+  pthread_mutex_unlock(&gUpdateMutex);
 
-  //ui_free_bitmaps();
+  ev_exit();
+  lat_dump();
 }
 
 void ui_set_background(int icon)
@@ -913,6 +1718,7 @@ void ui_print_str(char *str) {
       if (*ptr != '\n') text[text_row][text_col++] = *ptr;
     }
     text[text_row][text_col] = '\0';
+    text_serial++;
   }
   pthread_mutex_unlock(&gUpdateMutex);
 }
@@ -930,12 +1736,14 @@ void ui_print(const char *fmt, ...)
 
 void ui_start_menu(char** headers, char** tabs, struct UiMenuItem* items, int initial_selection, int initial_position) {
   int i;
+  ui_restore();
   pthread_mutex_lock(&gUpdateMutex);
 
   if (text_rows > 0 && text_cols > 0) {
 
     tabitems=tabs;
     menu=items;
+    menu_source=headers;
 
     for (i = 0; i < MAX_ROWS; ++i) {
         if (headers[i] == NULL) break;
@@ -986,6 +1794,17 @@ void ui_end_menu() {
   if (show_menu > 0) {
       show_menu = 0;
   }
+  // the visible page still shows the menu
+  if (splash_drawn)
+    gr_splash_capture();
+  splash_drawn = 0;
+  pthread_mutex_unlock(&gUpdateMutex);
+}
+
+void ui_set_splash_menu(char** headers)
+{
+  pthread_mutex_lock(&gUpdateMutex);
+  splash_menu = headers;
   pthread_mutex_unlock(&gUpdateMutex);
 }
 
@@ -999,6 +1818,8 @@ int ui_text_visible()
 
 void ui_show_text(int visible)
 {
+  if (visible)
+    ui_restore();
   pthread_mutex_lock(&gUpdateMutex);
   show_text = visible;
   pthread_mutex_unlock(&gUpdateMutex);
@@ -1016,20 +1837,15 @@ int ui_wait_key()
 int ui_wait_input(struct ui_input_event* pkey)
 {
   int ret = 0;
-  pthread_mutex_lock(&key_queue_mutex);
 
-  while (key_queue_len == 0 && evt_enabled) {
-    pthread_cond_wait(&key_queue_cond, &key_queue_mutex);
-  }
+  ui_restore();
+  lat_handled();
 
-  if (key_queue_len > 0) {
-    memcpy(pkey, &key_queue[0], sizeof(struct ui_input_event));
-    memcpy(&key_queue[0], &key_queue[1], sizeof(struct ui_input_event) * --key_queue_len);
-  } else {
-    ret = -1;
-  }
+  while ((ret = key_queue_pop(pkey)) < 0 && evt_enabled)
+    key_queue_wait();
 
-  pthread_mutex_unlock(&key_queue_mutex);
+  if (ret == 0)
+    lat_handed_out(pkey);
   return ret;
 }
 
@@ -1039,10 +1855,15 @@ int ui_key_pressed(int key)
   return key_pressed[key];
 }
 
+// from the thread calling ui_wait_input()
 void ui_clear_key_queue() {
-  pthread_mutex_lock(&key_queue_mutex);
-  key_queue_len = 0;
-  pthread_mutex_unlock(&key_queue_mutex);
+  while (key_queue_pop(NULL) == 0)
+    ;
+}
+
+void ui_get_queue_stats(struct ui_queue_stats *st)
+{
+  key_queue_get_stats(st);
 }
 
 void ui_get_time(char* result)